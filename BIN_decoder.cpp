@@ -0,0 +1,63 @@
+#include"BIN_decoder.hpp"
+
+size_t BIN::Decoder::decode(const uint8_t* data, size_t length)
+{
+	size_t consumed = 0;
+
+	while (length && !done() && !error() && decode(*data))
+	{
+		--length;
+		++consumed;
+		++data;
+	}
+
+	return consumed;
+}
+
+bool BIN::Decoder::decode(const uint8_t byte)
+{
+	if (done() || error())
+		return false;
+
+	if (header_pos < header_bytes)
+	{
+		crc = crc16(crc, byte);
+		const uint8_t shift = (header_pos & 3) * 8;
+		if (header_pos < 4)
+			address |= static_cast<uint32_t>(byte) << shift;
+		else
+			remaining |= static_cast<uint32_t>(byte) << shift;
+		++header_pos;
+		return true;
+	}
+
+	if (remaining)
+	{
+		crc = crc16(crc, byte);
+		--remaining;
+		return pages.store(address++, byte);
+	}
+
+	received_crc |= static_cast<uint16_t>(byte) << (crc_pos * 8);
+	if (++crc_pos == 2)
+	{
+		if (received_crc != crc)
+		{
+			pages.fail("Invalid CRC");
+			return false;
+		}
+		pages.count_record();
+		pages.finish();
+	}
+	return true;
+}
+
+// bitwise rather than table driven, the table would cost 512 bytes of
+// flash and the serial line is far slower than this anyway
+uint16_t BIN::Decoder::crc16(uint16_t crc, const uint8_t byte)
+{
+	crc ^= static_cast<uint16_t>(byte) << 8;
+	for (uint8_t bit = 0; bit < 8; ++bit)
+		crc = crc & 0x8000 ? crc << 1 ^ 0x1021 : crc << 1;
+	return crc;
+}
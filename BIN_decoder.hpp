@@ -0,0 +1,71 @@
+#ifndef BIN_decoder_HPP
+#define BIN_decoder_HPP
+
+#include"paged_decoder.hpp"
+
+namespace BIN
+{
+	// Decodes a length prefixed raw binary image into the pages of a
+	// paged::Decoder, for example the one of an I8HEX::Decoder so
+	// both formats share its buffers.  The image is, with multi
+	// byte fields least significant byte first:
+	//   4 bytes  address on target of first data byte
+	//   4 bytes  number of data bytes that follow
+	//   data
+	//   2 bytes  CRC-16/XMODEM of all bytes before it
+	// The pages are only handed over once the CRC is verified,
+	// pages evicted from the cache before then are already written.
+	class Decoder
+	{
+	public:
+		// decoded bytes are stored in pages which must outlive
+		// the decoder, its callbacks are called as usual
+		explicit Decoder(paged::Decoder& pages)
+			: pages(pages)
+		{
+		}
+
+		// return number of bytes consumed
+		// check result of done(), error()
+		// when it returns
+		size_t decode(const uint8_t* data, size_t length);
+
+		// return true if byte consumed, false if an error
+		// condition occurred in which case error()
+		// will return a valid pointer (not nullptr)
+		// check result of done(), error()
+		// when it returns
+		bool decode(uint8_t byte);
+
+		// return true if all input was decoded up to the CRC
+		bool done() const
+		{
+			return pages.done();
+		}
+
+		// return nullptr if no errors, otherwise string to error
+		const char* error() const
+		{
+			return pages.error();
+		}
+
+		// return CRC-16/XMODEM (polynomial 0x1021, initial 0)
+		// of crc updated with byte
+		static uint16_t crc16(uint16_t crc, uint8_t byte);
+
+	private:
+
+		paged::Decoder& pages;
+
+		static const uint8_t header_bytes = 8;
+
+		uint8_t header_pos = 0;  // header bytes decoded so far
+		uint32_t address = 0;    // of next data byte
+		uint32_t remaining = 0;  // data bytes still to decode
+		uint16_t crc = 0;        // of bytes decoded so far
+		uint16_t received_crc = 0;
+		uint8_t crc_pos = 0;     // CRC bytes decoded so far
+	};
+}
+
+#endif
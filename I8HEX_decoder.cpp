@@ -6,6 +6,18 @@ size_t I8HEX::Decoder::decode(const char* str, size_t length)
 
 	while (length && !done() && !error())
 	{
+		if (decoder_func == &Decoder::decode_colon && *str == ':')
+		{
+			const size_t record_length =
+				decode_record(str, length);
+			if (record_length)
+			{
+				length -= record_length;
+				consumed += record_length;
+				str += record_length;
+				continue;
+			}
+		}
 		if (decode(*str))
 		{
 			--length;
@@ -19,20 +31,8 @@ size_t I8HEX::Decoder::decode(const char* str, size_t length)
 
 bool I8HEX::Decoder::hexbyte::decode(const char c, const char*& error_str)
 {
-	uint8_t nibble;
-	if (c >= '0' && c <= '9')
-	{
-		nibble = c - '0';
-	}
-	else if (c >= 'a' && c <= 'f')
-	{
-		nibble = c - 'a' + 10;
-	}
-	else if (c >= 'A' && c <= 'F')
-	{
-		nibble = c - 'A' + 10;
-	}
-	else
+	const uint8_t value = nibble(c);
+	if (value & 0xf0)
 	{
 		error_str = "Invalid character, expected hexadecimal digit";
 		return false;
@@ -45,16 +45,71 @@ bool I8HEX::Decoder::hexbyte::decode(const char c, const char*& error_str)
 		shift = 0;
 	}
 
-	val = val << shift | nibble;
+	val = val << shift | value;
 	shift += 4;
 	return true;
 }
 
-void I8HEX::Decoder::call_buffer_full_callback()
+// Decode whole data record starting with the colon at str in one pass,
+// a payload crossing a page boundary is split there and continues into
+// the next page, return number of char consumed up to the newline or 0
+// (nothing consumed) if the record is not complete in str, is not a
+// data record or is invalid, in which case the character by character
+// decoder deals with it.
+size_t I8HEX::Decoder::decode_record(const char* str, const size_t length)
 {
-	error_str = (*buffer_full_callback)(*this);
-	bufptr = nullptr;
-	memset(buffer, -1, page_size);
+	// colon, length, address, record type, payload, checksum
+	if (length < 11)
+		return 0;
+	const int16_t payload_length = hex_pair(str + 1);
+	const int16_t address_msb_val = hex_pair(str + 3);
+	const int16_t address_lsb_val = hex_pair(str + 5);
+	const int16_t record_type_val = hex_pair(str + 7);
+	if (payload_length <= 0 || address_msb_val < 0 ||
+	    address_lsb_val < 0 || record_type_val != data)
+		return 0;
+	const size_t record_length = 11 + 2 * payload_length;
+	if (length < record_length)
+		return 0;
+
+	const uint32_t record_address = address_base +
+		(address_msb_val << 8 | address_lsb_val);
+
+	uint8_t sum = payload_length + address_msb_val + address_lsb_val;
+	const char* payload = str + 9;
+	for (const char* p = payload; p <= payload + 2 * payload_length;
+	     p += 2)
+	{
+		const int16_t value = hex_pair(p); // last is checksum
+		if (value < 0)
+			return 0;
+		sum += value;
+	}
+	if (sum)
+		return 0;
+
+	if (!in_buffer(record_address) && !select_page(record_address))
+		return 0;
+	offset = record_address - buffer_address;
+	remaining = page_size - offset;
+
+	for (uint8_t ix = 0; ix < payload_length && !error_str; ++ix)
+	{
+		if (remaining == 0)
+		{
+			// continue into the next page
+			if (!select_page(buffer_address + page_size, false))
+				break;
+			offset = 0;
+			remaining = page_size;
+		}
+		store_payload_byte(hex_pair(payload + 2 * ix));
+	}
+
+	I8HEX_STATS(++stats.records);
+	record_type.val = data;
+	decoder_func = &Decoder::decode_upto_newline;
+	return record_length;
 }
 
 bool I8HEX::Decoder::decode_colon(const char c)
@@ -94,7 +149,7 @@ bool I8HEX::Decoder::decode_address(const char c)
 			address = address_msb.val << 8 | address_lsb.val;
 			calculated_checksum += address_msb.val;
 			calculated_checksum += address_lsb.val;
-			decoder_func = &Decoder::address_check;
+			decoder_func = &Decoder::decode_record_type;
 			address_msb.reset();
 			address_lsb.reset();
 		}
@@ -105,39 +160,19 @@ bool I8HEX::Decoder::decode_address(const char c)
 
 bool I8HEX::Decoder::address_check(const char c)
 {
-	if (bufptr) // busy decoding buffer
-	{
-		if (address < buffer_address ||
-		    address >= buffer_address + page_size)
-		{
-			// new address is outside range of current buffer
-			if (expected_length.val)
-			{
-				// and there will be data to decode,
-				// so flag current buffer as full
-				call_buffer_full_callback();
-				return false;
-			}
-			// although new address is outside of current
-			// buffer range this I8HEX line does not have any
-			// data to contribute so leave bufptr unchanged
-		}
-		else
-		{
-			// new address is within current buffer
-			bufptr = buffer + (address - buffer_address);
-		}
-	}
-	else // not busy decoding buffer
+	// a line without data to contribute leaves the buffer and
+	// offset unchanged, otherwise switch to the page of address
+	if (expected_length.val && !in_buffer(address) &&
+	    !select_page(address))
+		return false;
+	if (in_buffer(address))
 	{
-		// round buffer_address down to nearest page_size
-		size_t remainder = address % page_size;
-		buffer_address = address - remainder;
-		bufptr = buffer + remainder;
-		remaining = page_size - remainder;
+		// new address is within current buffer
+		offset = address - buffer_address;
+		remaining = page_size - offset;
 	}
 
-	decoder_func = &Decoder::decode_record_type;
+	decoder_func = &Decoder::decode_payload;
 	return decode(c);
 }
 
@@ -148,15 +183,40 @@ bool I8HEX::Decoder::decode_record_type(const char c)
 		if (record_type.done())
 		{
 			calculated_checksum += record_type.val;
-			if (record_type.val == 0x00 ||
-			    record_type.val == 0x01)
-			{
-				decoder_func = &Decoder::decode_payload;
-			}
-			else
+			switch (record_type.val)
 			{
+			case data:
+			case end_of_file:
+				address += address_base;
+				decoder_func = &Decoder::address_check;
+				break;
+			case extended_segment_address:
+			case extended_linear_address:
+				if (expected_length.val != 2)
+				{
+					error_str = "Invalid extended "
+						"address record length";
+					return false;
+				}
+				address_payload = 0;
+				decoder_func =
+					&Decoder::decode_address_payload;
+				break;
+			case start_segment_address:
+			case start_linear_address:
+				if (expected_length.val != 4)
+				{
+					error_str = "Invalid start "
+						"address record length";
+					return false;
+				}
+				address_payload = 0;
+				decoder_func =
+					&Decoder::decode_address_payload;
+				break;
+			default:
 				error_str = "Invalid/unsupported record "
-					"type, must be 0 or 1";
+					"type, must be 0 to 5";
 				return false;
 			}
 		}
@@ -171,17 +231,17 @@ bool I8HEX::Decoder::decode_payload(const char c)
 	{
 		if (remaining == 0)
 		{
-			decoder_func = &Decoder::adjust_after_full;
-			call_buffer_full_callback();
-			return false;
+			// continue into the next page
+			if (!select_page(buffer_address + page_size, false))
+				return false;
+			offset = 0;
+			remaining = page_size;
 		}
 		if (payload_byte.decode(c, error_str))
 		{
 			if (payload_byte.done())
 			{
-				*bufptr = payload_byte.val;
-				++bufptr;
-				--remaining;
+				store_payload_byte(payload_byte.val);
 				--expected_length.val;
 				calculated_checksum += payload_byte.val;
 			}
@@ -196,12 +256,25 @@ bool I8HEX::Decoder::decode_payload(const char c)
 	return false;
 }
 
-bool I8HEX::Decoder::adjust_after_full(const char c)
+bool I8HEX::Decoder::decode_address_payload(const char c)
 {
-	buffer_address += page_size;
-	bufptr = buffer;
-	remaining = page_size;
-	decoder_func = &Decoder::decode_payload;
+	if (expected_length.val)
+	{
+		if (payload_byte.decode(c, error_str))
+		{
+			if (payload_byte.done())
+			{
+				address_payload = address_payload << 8 |
+					payload_byte.val;
+				--expected_length.val;
+				calculated_checksum += payload_byte.val;
+			}
+			return true;
+		}
+		return false;
+	}
+
+	decoder_func = &Decoder::decode_checksum;
 	return decode(c);
 }
 
@@ -217,6 +290,14 @@ bool I8HEX::Decoder::decode_checksum(const char c)
 				error_str = "Invalid checksum";
 				return false;
 			}
+			I8HEX_STATS(++stats.records);
+
+			// start address records (0x03, 0x05) are of
+			// no use to a programmer and ignored
+			if (record_type.val == extended_segment_address)
+				address_base = address_payload << 4;
+			else if (record_type.val == extended_linear_address)
+				address_base = address_payload << 16;
 
 			decoder_func = &Decoder::decode_upto_newline;
 		}
@@ -229,13 +310,14 @@ bool I8HEX::Decoder::decode_upto_newline(const char c)
 {
 	if (c == '\n')
 	{
-		if (record_type.val == 0x01)
+		if (record_type.val == end_of_file)
 		{
 			done_flag = true;
 			// buffer is full if there was decoding
 			// in progress
 			decoder_func = &Decoder::decode_done;
-			call_buffer_full_callback();
+			if (busy)
+				flush_pages();
 			return false;
 		}
 		decoder_func = &Decoder::decode_colon;
@@ -1,39 +1,22 @@
 #ifndef I8HEX_decoder_HPP
 #define I8HEX_decoder_HPP
 
-#include<stdint.h>
-#include<stddef.h>
-#include<string.h>
+#include"paged_decoder.hpp"
 
 namespace I8HEX
 {
-	class Decoder
+	class Decoder : public paged::Decoder
 	{
 	public:
-		// callback type used to notify of decoded I8HEX buffer
-		// It should return an error string in case of failure
-		// dealing with a full buffer or nullptr if success.
-		// The buffer address in ram, and address on target device
-		// (and page size) can be retrieved from Decoder argument.
-		typedef const char* (*buffer_full_callback_type)
-			(const Decoder&);
-
-		// construct with external buffer to use to decode I8HEX
-		// bytes into, it must be the same size as target chip
-		// page size
-		Decoder(void* const buffer,
-			const size_t page_size,
-			buffer_full_callback_type bfc)
-			: buffer(static_cast<uint8_t*>(buffer))
-			, page_size(page_size)
-			, buffer_full_callback(bfc)
-		{
-			memset(buffer, -1, page_size);
-		}
+		using paged::Decoder::Decoder;
 
 		// return number of char consumed
 		// check result of done(), error()
 		// when it returns
+		// Whole data records within str are decoded in one pass
+		// (split at page boundaries), anything else (records
+		// split across calls, errors) falls back to decoding
+		// character by character.
 		size_t decode(const char* str, size_t length);
 
 		// return true if char consumed, false if an error
@@ -46,44 +29,8 @@ namespace I8HEX
 			return (this->*decoder_func)(c);
 		}
 
-		// return address where buffer should be loaded on target
-		// chip, this address is decoded from I8Hex and aligned
-		// on a page_size boundary
-		uint16_t get_buffer_address_on_target() const
-		{
-			return buffer_address;
-		}
-
-		// return true if all input was decoded and record type 0x01
-		// was decoded
-		// (check error() to check if decode was successful)
-		bool done() const
-		{
-			return done_flag;
-		}
-
-		// return nullptr if no errors, otherwise string to error
-		const char* error() const
-		{
-			return error_str;
-		}
-
-		// public for callback to retrieve
-		uint8_t* const buffer;
-		const size_t page_size;
-
-		// may replace callback if required
-		buffer_full_callback_type buffer_full_callback;;
-
 	private:
 
-		// bufptr points to the next byte into which to decode
-		// a value of nullptr indicates no decoding has taken place
-		uint8_t* bufptr = nullptr;  // next byte to decode into
-		size_t remaining;           // remaining bytes to decode
-		bool done_flag = false;
-		const char* error_str = nullptr;
-
 		struct hexbyte
 		{
 			uint8_t val;       // deliberately not initialised
@@ -96,17 +43,32 @@ namespace I8HEX
 		};
 
 		hexbyte expected_length; // number of payload bytes to decode
-		uint16_t address;        // decode address into this field
+		uint32_t address;        // decode address into this field
 		hexbyte address_msb;     // helper to decode address
 		hexbyte address_lsb;     // helper to decode address
-		hexbyte record_type;     // 0x00 or 0x01 for last decode
+		hexbyte record_type;     // 0x00 to 0x05, see record_types
 		hexbyte payload_byte;    // current payload byte being decoded
 		hexbyte checksum;        // decode into this
 
-		uint16_t buffer_address; // address of page aligned buffer
+		// base added to record addresses, set by extended
+		// segment (0x02) and extended linear (0x04) records
+		uint32_t address_base = 0;
+		// payload of address records (0x02 to 0x05)
+		uint32_t address_payload;
+
 		uint8_t calculated_checksum;
 
-		void call_buffer_full_callback();
+		enum record_types : uint8_t
+		{
+			data                     = 0x00,
+			end_of_file              = 0x01,
+			extended_segment_address = 0x02,
+			start_segment_address    = 0x03,
+			extended_linear_address  = 0x04,
+			start_linear_address     = 0x05
+		};
+
+		size_t decode_record(const char* str, size_t length);
 
 		typedef bool (Decoder::*decfunc)(const char);
 
@@ -116,7 +78,7 @@ namespace I8HEX
 		bool address_check(const char);
 		bool decode_record_type(const char);
 		bool decode_payload(const char);
-		bool adjust_after_full(const char);
+		bool decode_address_payload(const char);
 		bool decode_checksum(const char);
 		bool decode_upto_newline(const char);
 		bool decode_done(const char);
@@ -0,0 +1,122 @@
+#include"I8HEX_encoder.hpp"
+
+namespace
+{
+	// return number of 0xff bytes at the start of data
+	size_t erased_run(const uint8_t* data, const size_t bytes)
+	{
+		size_t run = 0;
+		while (run < bytes && data[run] == 0xff)
+			++run;
+		return run;
+	}
+}
+
+void I8HEX::Encoder::encode(uint32_t address,
+			    const void* data,
+			    size_t bytes)
+{
+	const uint8_t* ptr = static_cast<const uint8_t*>(data);
+
+	while (bytes)
+	{
+		if (elide_erased)
+		{
+			// leading run, at least min_erased_run long or
+			// the start or end of data
+			const size_t run = erased_run(ptr, bytes);
+			if (run && (run >= min_erased_run ||
+				    run == bytes ||
+				    ptr == data))
+			{
+				address += run;
+				ptr += run;
+				bytes -= run;
+				continue;
+			}
+		}
+
+		// record ends at record_length, end of data, 64K segment
+		// or a run of 0xff to elide
+		size_t limit = 0x10000 - (address & 0xffff);
+		if (limit > record_length)
+			limit = record_length;
+		if (limit > bytes)
+			limit = bytes;
+		size_t length = 1;
+		for (; length < limit; ++length)
+		{
+			if (elide_erased && ptr[length] == 0xff &&
+			    ptr[length - 1] != 0xff)
+			{
+				const size_t run = erased_run(ptr + length,
+							      bytes - length);
+				if (run >= min_erased_run ||
+				    length + run == bytes)
+					break;
+			}
+		}
+
+		if (address >> 16 != segment)
+		{
+			segment = address >> 16;
+			const uint8_t upper[] = {
+				static_cast<uint8_t>(segment >> 8),
+				static_cast<uint8_t>(segment & 0xff)
+			};
+			write_record(0, 0x04, upper, sizeof(upper));
+		}
+		write_record(address & 0xffff, 0x00, ptr, length);
+
+		address += length;
+		ptr += length;
+		bytes -= length;
+	}
+}
+
+void I8HEX::Encoder::end()
+{
+	write_record(0, 0x01, nullptr, 0);
+}
+
+void I8HEX::Encoder::write_record(const uint16_t address,
+				  const uint8_t record_type,
+				  const uint8_t* data,
+				  uint8_t bytes)
+{
+	checksum = 0;
+	put_char(':');
+	put_byte(bytes);
+	put_byte(address >> 8);
+	put_byte(address & 0xff);
+	put_byte(record_type);
+	for (; bytes; --bytes)
+		put_byte(*data++);
+	put_byte(-checksum);
+	put_char('\r');
+	put_char('\n');
+	flush(); // whole lines, so other output can't split them
+}
+
+void I8HEX::Encoder::put_char(const char c)
+{
+	if (output_length == sizeof(output))
+		flush();
+	output[output_length++] = c;
+}
+
+void I8HEX::Encoder::put_byte(const uint8_t byte)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	put_char(digits[byte >> 4]);
+	put_char(digits[byte & 0xf]);
+	checksum += byte;
+}
+
+void I8HEX::Encoder::flush()
+{
+	if (output_length)
+		(*write_sink)(sink_object ? sink_object : this,
+			      output, output_length);
+	output_length = 0;
+}
@@ -0,0 +1,94 @@
+#ifndef I8HEX_encoder_HPP
+#define I8HEX_encoder_HPP
+
+#include<stdint.h>
+#include<stddef.h>
+
+namespace I8HEX
+{
+	class Encoder
+	{
+	public:
+		// callback type used to write encoded I8HEX characters,
+		// lines are terminated with "\r\n"
+		typedef void (*write_callback_type)(const char*, size_t);
+
+		// runs of at least this many 0xff bytes are left out when
+		// eliding erased bytes, shorter runs cost less to encode
+		// than the framing of the record that would follow
+		static const uint8_t min_erased_run = 6;
+
+		// construct to encode data records of up to record_length
+		// (1 to 255) bytes written to wc.  With elide_erased runs
+		// of 0xff bytes are not encoded (the decoder pre-fills its
+		// buffer with 0xff) as well as any at the start or end of
+		// the data passed to encode().
+		Encoder(const uint8_t record_length,
+			write_callback_type wc,
+			const bool elide_erased = false)
+			: record_length(record_length ? record_length : 1)
+			, elide_erased(elide_erased)
+			, write_callback(wc)
+		{
+		}
+
+		// construct as above writing to sink, any object callable
+		// as sink(const char*, size_t) which outlives the encoder
+		template <typename Sink>
+		Encoder(const uint8_t record_length,
+			Sink& sink,
+			const bool elide_erased = false)
+			: Encoder(record_length, nullptr, elide_erased)
+		{
+			sink_object = &sink;
+			write_sink = &call_write_sink<Sink>;
+		}
+
+		// encode bytes of data which reside at address on target,
+		// preceded by an extended linear address record (0x04)
+		// whenever address moves into another 64K segment
+		void encode(uint32_t address, const void* data, size_t bytes);
+
+		// encode end of file record
+		void end();
+
+	private:
+
+		const uint8_t record_length;
+		const bool elide_erased;
+		write_callback_type write_callback;
+
+		typedef void (*write_sink_type)(void*, const char*, size_t);
+		void* sink_object = nullptr;
+		write_sink_type write_sink = &call_write_callback_adapter;
+
+		static void call_write_callback_adapter(void* encoder,
+							const char* str,
+							const size_t length)
+		{
+			(*static_cast<Encoder*>(encoder)->write_callback)(
+				str, length);
+		}
+
+		template <typename Sink>
+		static void call_write_sink(void* sink,
+					    const char* str,
+					    const size_t length)
+		{
+			(*static_cast<Sink*>(sink))(str, length);
+		}
+
+		uint16_t segment = 0;    // upper 16 bits of last address
+		uint8_t checksum;        // of record being encoded
+		char output[32];         // characters of record to write
+		uint8_t output_length = 0;
+
+		void write_record(uint16_t address, uint8_t record_type,
+				  const uint8_t* data, uint8_t bytes);
+		void put_char(char);
+		void put_byte(uint8_t);
+		void flush();
+	};
+}
+
+#endif
@@ -0,0 +1,126 @@
+#include"SREC_decoder.hpp"
+
+namespace
+{
+	// number of address bytes of each record type S0 to S9, 0 for
+	// the reserved S4
+	const PROGMEM uint8_t address_bytes_of_type[10] =
+		{ 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+}
+
+size_t SREC::Decoder::decode(const char* str, size_t length)
+{
+	size_t consumed = 0;
+
+	while (length && !done() && !error() && decode(*str))
+	{
+		--length;
+		++consumed;
+		++str;
+	}
+
+	return consumed;
+}
+
+bool SREC::Decoder::decode(const char c)
+{
+	switch (expecting)
+	{
+	case state::start:
+		if (c != 'S')
+			return fail("Invalid character, expected S");
+		expecting = state::type;
+		return true;
+
+	case state::type:
+		record_type = c - '0';
+		if (record_type > 9 || record_type == 4)
+			return fail("Invalid/unsupported record type, "
+				    "must be S0 to S9 except S4");
+		address_bytes = pgm_read_byte(
+			&address_bytes_of_type[record_type]);
+		msn = 0xff;
+		bytes = 0;
+		sum = 0;
+		expecting = state::digits;
+		return true;
+
+	case state::digits:
+	{
+		const uint8_t value = paged::Decoder::nibble(c);
+		if (value & 0xf0)
+			return fail("Invalid character, "
+				    "expected hexadecimal digit");
+		if (msn & 0xf0)
+		{
+			msn = value;
+			return true;
+		}
+		const uint8_t byte = msn << 4 | value;
+		msn = 0xff;
+		return decode_byte(byte);
+	}
+
+	case state::newline:
+		// anything after the checksum up to newline is ignored
+		if (c == '\n')
+		{
+			if (record_type >= 7)
+			{
+				// termination record, hand over the pages
+				expecting = state::done;
+				pages.finish();
+			}
+			else
+			{
+				expecting = state::start;
+			}
+		}
+		return true;
+
+	case state::done:
+		break;
+	}
+	return false;
+}
+
+// byte 0 of a record is its count of the bytes that follow: address,
+// data and checksum, the checksum is the ones' complement of the sum
+// of all bytes before it
+bool SREC::Decoder::decode_byte(const uint8_t value)
+{
+	sum += value;
+	if (bytes == 0)
+	{
+		count = value;
+		if (count <= address_bytes)
+			return fail("Invalid record length");
+		address = 0;
+	}
+	else if (bytes <= address_bytes)
+	{
+		address = address << 8 | value;
+	}
+	else if (bytes < count)
+	{
+		// S0 header and S5/S6 count records carry nothing to load
+		if (record_type >= 1 && record_type <= 3 &&
+		    !pages.store(address++, value))
+			return false;
+	}
+	else
+	{
+		if (sum != 0xff)
+			return fail("Invalid checksum");
+		pages.count_record();
+		expecting = state::newline;
+	}
+	++bytes;
+	return true;
+}
+
+bool SREC::Decoder::fail(const char* const error)
+{
+	pages.fail(error);
+	return false;
+}
@@ -0,0 +1,73 @@
+#ifndef SREC_decoder_HPP
+#define SREC_decoder_HPP
+
+#include"paged_decoder.hpp"
+
+namespace SREC
+{
+	// Decodes Motorola S-records (S19, S28 and S37 files) into the
+	// pages of a paged::Decoder, for example the one of an
+	// I8HEX::Decoder so both formats share its buffers.
+	class Decoder
+	{
+	public:
+		// decoded bytes are stored in pages which must outlive
+		// the decoder, its callbacks are called as usual
+		explicit Decoder(paged::Decoder& pages)
+			: pages(pages)
+		{
+		}
+
+		// return number of char consumed
+		// check result of done(), error()
+		// when it returns
+		size_t decode(const char* str, size_t length);
+
+		// return true if char consumed, false if an error
+		// condition occurred in which case error()
+		// will return a valid pointer (not nullptr)
+		// check result of done(), error()
+		// when it returns
+		bool decode(const char c);
+
+		// return true if all input was decoded up to the
+		// termination record (S7, S8 or S9)
+		bool done() const
+		{
+			return pages.done();
+		}
+
+		// return nullptr if no errors, otherwise string to error
+		const char* error() const
+		{
+			return pages.error();
+		}
+
+	private:
+
+		paged::Decoder& pages;
+
+		enum class state : uint8_t
+		{
+			start,      // expecting 'S'
+			type,       // expecting record type digit
+			digits,     // expecting hexadecimal digits
+			newline,    // expecting newline after checksum
+			done
+		};
+
+		state expecting = state::start;
+		uint8_t record_type;   // 0 to 9
+		uint8_t address_bytes; // in the record type's address
+		uint8_t msn;           // first digit of byte, 0xff if none
+		uint8_t bytes;         // decoded so far in this record
+		uint8_t count;         // byte count field of record
+		uint8_t sum;           // of all bytes, checksum included
+		uint32_t address;      // of next data byte
+
+		bool decode_byte(uint8_t);
+		bool fail(const char*);
+	};
+}
+
+#endif
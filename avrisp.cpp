@@ -2,19 +2,154 @@
 #include<avr/pgmspace.h>
 #include<HardwareSerial.h>
 
+#include"BIN_decoder.hpp"
 #include"I8HEX_decoder.hpp"
+#include"I8HEX_encoder.hpp"
+#include"SREC_decoder.hpp"
 #include"devices.hpp"
+#include"gang_programmer.hpp"
+#include"golden_images.hpp"
+#include"patches.hpp"
+#include"target_clock.hpp"
 #include"high_volt_programmer.hpp"
 #include"spi_programmer.hpp"
 #include"util.hpp"
 
+namespace gang = gang_programmer;
 namespace hvspgm = high_volt_programmer;
 namespace spipgm = spi_programmer;
 
 namespace
 {
 	bool verbose = false;
-	bool perform_load_image = false; // used by load_image
+
+	// target EEPROM details used by load_image
+	struct eeprom_load_t
+	{
+		uint16_t size;
+		bool page_mode;        // false if written bytewise
+		uint16_t pages_written;
+		uint16_t pages_unchanged;
+	};
+
+	// target flash details used by load_image, the chip is only erased
+	// when a page needs bits set which are currently clear
+	struct flash_load_t
+	{
+		uint32_t size;
+		uint8_t erased;        // targets (bit per socket) erased
+		uint8_t reload;        // targets erased after pages were loaded
+		bool merge;            // ;merge, overlay pages onto target
+		uint16_t pages_written;
+		uint16_t pages_unchanged;
+	};
+
+	// SPI clocks of single target loading, pages are loaded at the
+	// write clock and verified at the read clock, a verify failure
+	// halves them and they climb back after clock_climb_pages
+	struct load_clock_t
+	{
+		uint32_t max;          // clock programming was enabled at
+		uint32_t write;
+		uint32_t read;
+		uint8_t clean_pages;   // pages verified since last change
+	} load_clock;
+
+	// CRC-16 of the bytes loaded into the page being streamed, erased
+	// where none were, compared with the CRC of the page read back
+	// after it is written so streaming needs no RAM page
+	struct stream_page_t
+	{
+		bool started;          // a byte was loaded into the page
+		uint16_t next;         // offset after the last byte loaded
+		uint16_t crc;
+	};
+
+	// state of one load_image_from_serial(), the sinks of its
+	// decoders hand pages to the loading functions with it
+	struct image_load_t
+	{
+		bool perform;          // false once the load is abandoned
+		flash_load_t flash;
+		eeprom_load_t eeprom;
+		stream_page_t stream;
+	};
+
+	// RAM for flash pages cached by the decoder while loading, pages
+	// revisited by out of order images (e.g. .data after .text) are
+	// merged in the cache and written once
+	constexpr uint16_t flash_cache_bytes = 256;
+
+	// data bytes per I8HEX record of backup images, 11 characters
+	// of each record are framing plus \r\n, records must fit the
+	// record buffer of load_image_from_serial() to be reloaded a
+	// line at a time
+	constexpr uint8_t backup_record_length = 32;
+	// the decoder only takes the one pass path for records complete in
+	// the buffer, so records of up to 44 data bytes ((100 - 11) / 2)
+	// are decoded fast, longer ones character by character
+	constexpr size_t record_buffer_size = 100;
+	static_assert(backup_record_length * 2 + 13 <= record_buffer_size,
+		      "backup records must fit in the record buffer");
+
+	// time for a directive to follow a complete flash image, backups
+	// have their ;eeprom section after it
+	constexpr unsigned long trailing_directive_ms = 1000;
+
+	constexpr uint8_t clock_climb_pages = 16;
+	constexpr uint32_t min_load_clock = 125000; // SPI can't go lower
+	constexpr uint8_t page_verify_retries = 4;
+
+	// gang sockets selected by operator
+	uint8_t gang_sockets = gang::all_sockets;
+	// true while load_image is writing to gang sockets
+	bool gang_loading = false;
+	uint8_t gang_live;   // sockets still being loaded
+	uint8_t gang_failed; // sockets which failed
+
+	// Call fn(socket) for each live gang socket with it selected, or
+	// once for the single target when not gang loading.
+	template <typename F>
+	void for_each_target(F fn)
+	{
+		if (!gang_loading)
+		{
+			fn(0);
+			return;
+		}
+		for (uint8_t socket = 0; socket < gang::max_sockets; ++socket)
+		{
+			if (gang_live & 1 << socket)
+			{
+				gang::select(socket);
+				fn(socket);
+			}
+		}
+	}
+
+	// production mode status LEDs (active HIGH), change to suit the
+	// fixture, analog pins are used as they are otherwise unused
+	constexpr uint8_t production_busy_led = A0;
+	constexpr uint8_t production_pass_led = A1;
+	constexpr uint8_t production_fail_led = A2;
+	// interval between attempts to detect a target in production mode
+	constexpr unsigned long production_poll_ms = 500;
+	// target settling time after insertion before programming
+	constexpr unsigned long production_settle_ms = 250;
+
+	// Record failure of target socket, return true if loading can
+	// continue with other gang sockets.
+	bool target_failed(const uint8_t socket)
+	{
+		if (!gang_loading)
+			return false;
+		Serial.print(F("Gang socket "));
+		Serial.print(socket + 1);
+		Serial.println(F(" failed"));
+		gang_live &= ~(1 << socket);
+		gang_failed |= 1 << socket;
+		return gang_live;
+	}
 }
 
 void setup()
@@ -26,7 +161,9 @@ void setup()
 // enable SPI programming of target device, return clock rate
 uint32_t enable_programming(bool verbose = false)
 {
-	uint32_t clock_rate = 8000000;
+	// SPI clock must be below a quarter of the target's clock
+	uint32_t clock_rate = target_clock::frequency() ?
+		target_clock::frequency() / 4 : 8000000;
 	while (!spipgm::program_enable(
 		       SPISettings(clock_rate, MSBFIRST, SPI_MODE0),
 		       2, // retries
@@ -37,6 +174,10 @@ uint32_t enable_programming(bool verbose = false)
 		clock_rate /= 2;
 		if (clock_rate < 5)
 		{
+			if (!target_clock::frequency())
+				Serial.println(F("\nIf the target's fuses select "
+						 "an external clock enable "
+						 "clock output with c"));
 			spipgm::powerdown_avr();
 			spipgm::failure(F("\nunable to enable programming"));
 			// unreachable, spipgm::failure does not return
@@ -125,10 +266,59 @@ void write_fuses()
 	}
 }
 
+// use write timing and fuse masks of device if known, otherwise
+// conservative defaults
+void set_device_for_signature()
+{
+	spipgm::set_device(devices::device_for_signature(
+		spipgm::read_signature(verbose)));
+}
+
+// list fuse presets of device and write the selected one
+void apply_fuse_preset()
+{
+	const uint32_t sig = spipgm::read_signature(verbose);
+	char options[11];
+	uint8_t count = 0;
+	for (; count < sizeof(options) - 2; ++count)
+	{
+		const devices::fuse_preset_pgm_t* preset =
+			devices::fuse_preset_for_signature(sig, count);
+		if (!preset)
+			break;
+		options[count] = '0' + count;
+		Serial.print(count);
+		Serial.print(F(" - "));
+		Serial.println(util::FF(&preset->preset_name));
+	}
+	if (!count)
+	{
+		Serial.println(F("No fuse presets for device"));
+		return;
+	}
+	Serial.println(F("q - quit without writing"));
+	options[count] = 'q';
+	options[count + 1] = 0;
+
+	const char c = util::serial_read_char_of(options);
+	if (c == 'q')
+		return;
+	const devices::fuse_preset_pgm_t* preset =
+		devices::fuse_preset_for_signature(sig, c - '0');
+	const spipgm::fuses_t fuses(spipgm::read_fuses(verbose).lock,
+				    preset->get_low(),
+				    preset->get_high(),
+				    preset->get_ext());
+	spipgm::output_fuses(fuses);
+	if (spipgm::write_verify_fuses(fuses, verbose))
+		Serial.println(F("Fuses written"));
+}
+
 void read_write_fuses()
 {
 	spipgm::powerup_avr();
 	enable_programming(verbose);
+	set_device_for_signature();
 
 	bool done = false;
 	while (!done)
@@ -136,9 +326,10 @@ void read_write_fuses()
 		Serial.println(F("=== Fuses ==="));
 		Serial.println(F("r - read fuses"));
 		Serial.println(F("w - write fuses"));
+		Serial.println(F("p - write fuse preset"));
 		Serial.println(F("q - quite fuses menu"));
 
-		char c = util::serial_read_char_of("rwq");
+		char c = util::serial_read_char_of("rwpq");
 		Serial.println();
 		switch (c)
 		{
@@ -148,6 +339,9 @@ void read_write_fuses()
 		case 'w' :
 			write_fuses();
 			break;
+		case 'p' :
+			apply_fuse_preset();
+			break;
 		case 'q' :
 			done = true;
 			break;
@@ -159,12 +353,13 @@ void read_write_fuses()
 }
 
 const devices::device_pgm_t* get_signature_flash_page_sizes(uint32_t& sig,
-							    uint16_t& flash,
+							    uint32_t& flash,
 							    uint16_t& page)
 {
 	sig = spipgm::read_signature(verbose);
 	const devices::device_pgm_t* dev_ptr =
 		devices::device_for_signature(sig);
+	spipgm::set_device(dev_ptr);
 
 	flash = 0;
 	page = 0;
@@ -173,8 +368,8 @@ const devices::device_pgm_t* get_signature_flash_page_sizes(uint32_t& sig,
 	{
 		Serial.print(F("CPU "));
 		Serial.println(util::FF(&dev_ptr->device_name));
-		flash = pgm_read_word(&dev_ptr->flash_size);
-		page = pgm_read_word(&dev_ptr->page_size);
+		flash = dev_ptr->get_flash_size();
+		page = dev_ptr->get_page_size();
 	}
 	else
 	{
@@ -200,6 +395,7 @@ void chip_erase()
 	{
 		spipgm::powerup_avr();
 		enable_programming(verbose);
+		set_device_for_signature();
 		Serial.print(F("erasing..."));
 		spipgm::wait_device_ready();
 		spipgm::perform_chip_erase(verbose);
@@ -218,6 +414,10 @@ namespace
 {
 	const PROGMEM char directive_sig[] = ";sig";
 	const PROGMEM char directive_fuses[] = ";fuses";
+	const PROGMEM char directive_eeprom[] = ";eeprom";
+	const PROGMEM char directive_patch[] = ";patch";
+	const PROGMEM char directive_merge[] = ";merge";
+	const PROGMEM char directive_bin[] = ";bin";
 	const PROGMEM char directive_end[] = ";end";
 }
 
@@ -227,7 +427,7 @@ void output_backup_image()
 	enable_programming(verbose);
 
 	uint32_t sig;
-	uint16_t flash_size;
+	uint32_t flash_size;
 	uint16_t page_size;
 	const devices::device_pgm_t* dev_ptr =
 		get_signature_flash_page_sizes(sig, flash_size, page_size);
@@ -265,15 +465,35 @@ void output_backup_image()
 		Serial.print(fuses.ext, HEX);
 		Serial.println(F("  (lock low high ext)"));
 
-		uint16_t addr = 0;
-		uint8_t bytes = page_size < 32 ? page_size : 32;
-		for (; addr < flash_size; addr += bytes)
+		I8HEX::Encoder encoder(backup_record_length,
+				       &util::serial_write);
+		for (uint32_t addr = 0; addr < flash_size; addr += page_size)
+		{
+			char data[page_size];
+			spipgm::read_program_memory(addr, data, page_size);
+			encoder.encode(addr, data, page_size);
+		}
+		encoder.end();
+
+		// EEPROM follows the flash image so that loading the
+		// backup writes it after any chip erase the flash needs
+		const uint16_t eeprom_size =
+			dev_ptr ? dev_ptr->get_eeprom_size() : 0;
+		if (eeprom_size)
 		{
-			char data[bytes];
-			spipgm::read_program_memory(addr, data, bytes);
-			util::serial_write_I8HEX(addr, data, bytes);
+			Serial.println(util::FF(directive_eeprom));
+			I8HEX::Encoder encoder(backup_record_length,
+					       &util::serial_write);
+			uint16_t addr = 0;
+			uint8_t bytes = eeprom_size < 32 ? eeprom_size : 32;
+			for (; addr < eeprom_size; addr += bytes)
+			{
+				char data[bytes];
+				spipgm::read_eeprom_memory(addr, data, bytes);
+				encoder.encode(addr, data, bytes);
+			}
+			encoder.end();
 		}
-		Serial.println(F(":00000001FF"));
 		Serial.println(util::FF(directive_end));
 
 		Serial.println(F("\nCopy and paste lines "
@@ -284,12 +504,75 @@ void output_backup_image()
 	spipgm::powerdown_avr();
 }
 
+// return true if all bytes are 0xff (erased flash)
+bool is_erased(const uint8_t* buffer, size_t bytes)
+{
+	for (; bytes; --bytes)
+		if (*buffer++ != 0xff)
+			return false;
+	return true;
+}
+
+enum class page_action : uint8_t
+{
+	unchanged, // page already holds wanted contents
+	write,     // wanted contents only clear bits, write without erase
+	erase      // wanted contents set bits, chip erase required
+};
+
+// return true if bit of byte at offset is set in mask (one bit per byte
+// of a page, as paged::Decoder::set_decoded_mask())
+bool is_masked(const uint8_t* mask, const uint16_t offset)
+{
+	return mask[offset >> 3] & 1 << (offset & 7);
+}
+
+// Decide how to get from current page contents to wanted contents.
+// With a mask only bytes whose bit is set are wanted, the others are
+// left as they are, bit offset + ix of mask is for wanted[ix].
+page_action page_action_for(const uint8_t* current,
+			    const uint8_t* wanted,
+			    const uint16_t bytes,
+			    const uint8_t* mask = nullptr,
+			    const uint16_t offset = 0)
+{
+	page_action action = page_action::unchanged;
+	for (uint16_t ix = 0; ix < bytes; ++ix)
+	{
+		if (wanted[ix] == current[ix] ||
+		    (mask && !is_masked(mask, offset + ix)))
+			continue;
+		if (wanted[ix] & ~current[ix])
+			return page_action::erase;
+		action = page_action::write;
+	}
+	return action;
+}
+
 void drain_serial()
 {
 	while (Serial.available())
 		Serial.read();
 }
 
+// Return true if the next character other than white space read from
+// serial within trailing_directive_ms starts a directive, it is left
+// to be read.
+bool directive_follows()
+{
+	const unsigned long start = millis();
+	while (millis() - start < trailing_directive_ms)
+	{
+		if (!Serial.available())
+			continue;
+		const int c = Serial.peek();
+		if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+			return c == ';';
+		Serial.read();
+	}
+	return false;
+}
+
 void drain_serial_to_nl(char& last_char)
 {
 	while (last_char != '\n')
@@ -304,13 +587,15 @@ void serial_print_error()
 }
 
 // verify serial reads return the value of directive_pgm in program memory
-// from its 2nd offset (3rd character) up to just before terminating nil
-bool verify_directive_from_offset2(const char* directive_pgm,
-				   size_t directive_pgm_size)
+// from offset up to just before terminating nil (the characters before
+// offset have already been read)
+bool verify_directive_from_offset(const char* directive_pgm,
+				  size_t directive_pgm_size,
+				  const size_t offset)
 {
 	Serial.println(util::FF(directive_pgm));
 	--directive_pgm_size;
-	for (size_t ix = 2; ix < directive_pgm_size; ++ix)
+	for (size_t ix = offset; ix < directive_pgm_size; ++ix)
 	{
 		const char c = util::serial_read_char();
 		if (pgm_read_byte(&directive_pgm[ix]) != c)
@@ -345,156 +630,1409 @@ bool verify_expected_signature_serial(const uint32_t sig, char& last_char)
 	return false;
 }
 
+// read ";patch <address> <length> <increment> [<initial>]" arguments
+bool add_patch_from_serial(char& last_char)
+{
+	uint32_t address;
+	uint8_t length;
+	uint32_t increment;
+	uint32_t initial = 0;
+	if (!util::serial_read_value(address, last_char) ||
+	    !util::serial_read_value(length, last_char) ||
+	    !util::serial_read_value(increment, last_char) ||
+	    ((last_char == ' ' || last_char == '\t') &&
+	     !util::serial_read_value(initial, last_char)))
+		return false;
+
+	if (gang_loading)
+	{
+		serial_print_error();
+		Serial.println(F("Patches would be the same on all sockets"));
+		return false;
+	}
+	if (!patches::add(address, length, increment, initial))
+	{
+		serial_print_error();
+		Serial.println(F("Invalid patch length or too many patches"));
+		return false;
+	}
+	return true;
+}
+
+// ;merge, only bytes set by the image are changed on the target
+bool set_merge_from_serial(flash_load_t& flash)
+{
+	if (gang_loading || flash.erased || flash.pages_written ||
+	    flash.pages_unchanged)
+	{
+		serial_print_error();
+		Serial.println(F("Merge needs a single target and must come "
+				 "before the flash records"));
+		return false;
+	}
+	flash.merge = true;
+	return true;
+}
+
 bool set_fuses_from_serial(char& last_char)
 {
 	spipgm::fuses_t fuses;
-	return util::serial_read_value(fuses.lock, last_char) &&
-		util::serial_read_value(fuses.low, last_char) &&
-		util::serial_read_value(fuses.high, last_char) &&
-		util::serial_read_value(fuses.ext, last_char) &&
-		spipgm::write_verify_fuses(fuses, verbose);
+	if (!util::serial_read_value(fuses.lock, last_char) ||
+	    !util::serial_read_value(fuses.low, last_char) ||
+	    !util::serial_read_value(fuses.high, last_char) ||
+	    !util::serial_read_value(fuses.ext, last_char))
+		return false;
+
+	bool success = true;
+	for_each_target([&](const uint8_t socket) {
+		if (!spipgm::write_verify_fuses(fuses, verbose))
+			success = target_failed(socket);
+	});
+	return success;
+}
+
+// decode lines of text records starting with the character in
+// record_buffer[0] into decoder (I8HEX::Decoder or SREC::Decoder),
+// return true if decoding is done (end of file or error)
+template <typename Decoder>
+bool process_text_records(image_load_t& load,
+			  char record_buffer[],
+			  const size_t record_buffer_size,
+			  Decoder& decoder,
+			  const __FlashStringHelper* format)
+{
+	// read more data to follow the initial character
+	size_t bytes_in_buffer = util::serial_read_until_nl(
+		&record_buffer[1], // append after initial character
+		record_buffer_size - 1) + 1; // account for it
+
+	do
+	{
+		const bool nl_in_buffer =
+			record_buffer[bytes_in_buffer - 1] == '\n';
+		decoder.decode(&record_buffer[0], bytes_in_buffer);
+		if (nl_in_buffer || decoder.done() || decoder.error())
+			break;
+
+		// read more data
+		bytes_in_buffer = util::serial_read_until_nl(
+			&record_buffer[0],
+			record_buffer_size);
+
+	} while (true);
+
+	if (decoder.error())
+	{
+		Serial.print(format);
+		Serial.println(F(" decode failed:"));
+		Serial.println(decoder.error());
+		load.perform = false;
+	}
+
+	return decoder.done() || decoder.error();
+}
+
+// The CRC of a binary image is only checked at its end, after pages
+// evicted from the cache were written, so the targets are chip erased
+// rather than left with part of a failed image.  A merge keeps the rest
+// of the target so nothing is erased then.
+void erase_failed_image(const image_load_t& load)
+{
+	if (!load.flash.pages_written && !load.eeprom.pages_written)
+		return;
+	if (load.flash.merge)
+	{
+		Serial.println(F("Pages merged before the error are left "
+				 "on the target"));
+		return;
+	}
+	Serial.println(F("Erasing chip loaded from failed image"));
+	for_each_target([](uint8_t) {
+		spipgm::wait_device_ready();
+		spipgm::perform_chip_erase(verbose);
+		spipgm::wait_device_ready();
+	});
+}
+
+// decode raw binary image (see BIN::Decoder) from serial into the pages
+// of decoder, return true if decoding is done (end of image or error)
+bool process_bin_image(image_load_t& load, paged::Decoder& pages)
+{
+	BIN::Decoder decoder(pages);
+	while (!decoder.done() && !decoder.error())
+		decoder.decode(util::serial_read_byte());
+
+	if (decoder.error())
+	{
+		Serial.println(F("BIN decode failed:"));
+		Serial.println(decoder.error());
+		load.perform = false;
+		erase_failed_image(load);
+	}
+
+	return decoder.done() || decoder.error();
 }
 
-bool process_load_directive(const uint32_t sig)
+// process a directive line, return true if loading is done (;end or
+// a failed directive which abandons the load)
+bool process_load_directive(image_load_t& load,
+			    const uint32_t sig,
+			    I8HEX::Decoder*& decoder,
+			    I8HEX::Decoder& eeprom_decoder)
 {
-	bool done = true;
+	bool done = false;
 
 	char last_char = util::serial_read_char();
 	switch (last_char)
 	{
-	case 's' :
-		if (verify_directive_from_offset2(directive_sig,
-						  sizeof(directive_sig)))
+	case 'b' :
+		if (!verify_directive_from_offset(directive_bin,
+						  sizeof(directive_bin), 2))
 		{
-			if (verify_expected_signature_serial(sig, last_char))
-				perform_load_image = false;
+			done = true;
 		}
-		break;
-	case 'f' :
-		if (verify_directive_from_offset2(directive_fuses,
-						  sizeof(directive_fuses)))
+		else
 		{
-			if (set_fuses_from_serial(last_char))
-				perform_load_image = false;
+			// image follows the directive line, its end is
+			// dealt with as the end of I8HEX records is so an
+			// ;eeprom section may follow a flash image
+			drain_serial_to_nl(last_char);
+			return process_bin_image(load, *decoder);
 		}
 		break;
+	case 's' :
+		if (!verify_directive_from_offset(directive_sig,
+						  sizeof(directive_sig), 2) ||
+		    !verify_expected_signature_serial(sig, last_char))
+			done = true;
+		break;
+	case 'f' :
+		if (!verify_directive_from_offset(directive_fuses,
+						  sizeof(directive_fuses), 2) ||
+		    !set_fuses_from_serial(last_char))
+			done = true;
+		break;
+	case 'p' :
+		if (!verify_directive_from_offset(directive_patch,
+						  sizeof(directive_patch), 2) ||
+		    !add_patch_from_serial(last_char))
+			done = true;
+		break;
+	case 'm' :
+		if (!verify_directive_from_offset(directive_merge,
+						  sizeof(directive_merge), 2) ||
+		    !set_merge_from_serial(load.flash))
+			done = true;
+		break;
 	case 'e' :
-		if (verify_directive_from_offset2(directive_end,
-						  sizeof(directive_end)))
+		last_char = util::serial_read_char();
+		if (last_char == 'e')
 		{
-			spipgm::wait_device_ready();
+			if (!verify_directive_from_offset(
+				    directive_eeprom,
+				    sizeof(directive_eeprom), 3))
+			{
+				done = true;
+			}
+			else if (!load.eeprom.size || eeprom_decoder.done())
+			{
+				serial_print_error();
+				Serial.println(F("No EEPROM to load or "
+						 "EEPROM already loaded"));
+				done = true;
+			}
+			else
+			{
+				decoder = &eeprom_decoder;
+			}
+		}
+		else if (last_char == 'n' &&
+			 verify_directive_from_offset(directive_end,
+						      sizeof(directive_end),
+						      3))
+		{
+			for_each_target([](uint8_t) {
+				spipgm::wait_device_ready();
+			});
 			Serial.println("## done ##");
+			done = true;
+		}
+		else
+		{
+			serial_print_error();
+			Serial.println(F("\nInvalid directive\n"));
+			done = true;
 		}
 		break;
 	default:
 		serial_print_error();
 		Serial.println(F("\nInvalid input, expected directive\n"));
+		done = true;
 	}
 
+	if (done)
+		load.perform = false;
 	drain_serial_to_nl(last_char);
 	return done;
 }
 
-bool process_i8hex_directive(char i8hex_buffer[],
-			     const size_t i8hex_buffer_size,
-			     const uint16_t flash_size,
-			     I8HEX::Decoder& decoder)
+// Chip erase the selected target part way through loading, any pages
+// already loaded are lost so the image must be loaded again.
+void erase_target_for_load(flash_load_t& flash,
+			   const uint8_t socket,
+			   const bool loaded_pages)
 {
-	// read more data to follow the colon
-	size_t bytes_in_buffer = util::serial_read_until_nl(
-		&i8hex_buffer[1], // append after initial ':'
-		i8hex_buffer_size - 1) + 1; // account for ':'
+	Serial.println(F("Page sets bits - erasing chip"));
+	spipgm::wait_device_ready();
+	spipgm::perform_chip_erase(verbose);
+	spipgm::wait_device_ready();
+	flash.erased |= 1 << socket;
+	if (loaded_pages)
+		flash.reload |= 1 << socket;
+}
 
-	do
+// Decide for each target if the page at address must be written,
+// erasing the target first when a byte of mask (those the image sets)
+// needs bits set which are clear.  Return targets (bit per socket) to
+// write the page to.
+uint8_t targets_to_write(image_load_t& load,
+			 const uint32_t address,
+			 const uint8_t* page,
+			 const uint8_t* mask,
+			 const uint16_t page_size)
+{
+	const bool loaded_pages = load.flash.pages_written ||
+		load.flash.pages_unchanged ||
+		load.eeprom.pages_written ||
+		load.eeprom.pages_unchanged;
+
+	uint8_t targets = 0;
+	uint8_t current[page_size];
+	for_each_target([&](const uint8_t socket) {
+		page_action action = page_action::write;
+		if (!(load.flash.erased & 1 << socket))
+		{
+			spipgm::wait_device_ready();
+			spipgm::read_program_memory(address, current,
+						    page_size, verbose);
+			action = page_action_for(current, page, page_size,
+						 mask);
+			if (action == page_action::erase)
+			{
+				erase_target_for_load(load.flash, socket,
+						      loaded_pages);
+				action = page_action::write;
+			}
+		}
+		if (action == page_action::write &&
+		    !(load.flash.erased & 1 << socket &&
+		      is_erased(page, page_size)))
+		{
+			targets |= 1 << socket;
+			++load.flash.pages_written;
+		}
+		else
+		{
+			++load.flash.pages_unchanged;
+		}
+	});
+	return targets;
+}
+
+// Narrow byte range [begin, end) of page buffer to whole words less
+// leading and trailing erased words, the target's page buffer is 0xff
+// after each page write so only the words between need loading.
+void trim_erased_words(const uint8_t* buffer, uint16_t& begin, uint16_t& end)
+{
+	begin &= ~1;
+	end = (end + 1) & ~1;
+	while (begin < end && buffer[begin] == 0xff && buffer[begin + 1] == 0xff)
+		begin += 2;
+	while (end > begin && buffer[end - 2] == 0xff && buffer[end - 1] == 0xff)
+		end -= 2;
+}
+
+// Load words [begin, end) of page into the targets gang sockets and
+// write it, the page writes run in parallel so the busy wait is spent
+// once, then verify the bytes of mask loaded into each.
+const char* gang_write_page(const paged::Decoder& decoder,
+			    const uint8_t* mask,
+			    const uint8_t targets,
+			    const uint16_t begin,
+			    const uint16_t end)
+{
+	const uint32_t address = decoder.get_buffer_address_on_target();
+	for_each_target([&](const uint8_t socket) {
+		if (targets & 1 << socket)
+			spipgm::load_program_memory(address + begin,
+						    decoder.buffer + begin,
+						    end - begin,
+						    verbose);
+	});
+	for_each_target([&](const uint8_t socket) {
+		if (targets & 1 << socket)
+			spipgm::write_program_page(address, verbose);
+	});
+
+	uint8_t readback[end - begin];
+	for_each_target([&](const uint8_t socket) {
+		if (!(targets & 1 << socket))
+			return;
+		if (!spipgm::wait_device_ready())
+		{
+			target_failed(socket);
+			return;
+		}
+		spipgm::read_program_memory(address + begin, readback,
+					    end - begin, verbose);
+		if (page_action_for(readback, decoder.buffer + begin,
+				    end - begin, mask, begin) !=
+		    page_action::unchanged)
+			target_failed(socket);
+	});
+
+	return gang_live ? nullptr : "All gang sockets failed";
+}
+
+// load words [begin, end) of page into the single target's page buffer
+// and write the page
+void write_page(const uint32_t address,
+		const uint8_t* buffer,
+		const uint16_t begin,
+		const uint16_t end)
+{
+	spipgm::wait_device_ready();
+	spipgm::load_program_memory(address + begin, buffer + begin,
+				    end - begin, verbose);
+	spipgm::write_program_page(address, verbose);
+}
+
+void output_load_clock()
+{
+	Serial.print(F("SPI clock write "));
+	Serial.print(load_clock.write);
+	Serial.print(F(" read "));
+	Serial.println(load_clock.read);
+}
+
+// read words [begin, end) of page at address at the read clock into
+// readback, return page action to get from them to the bytes of mask
+// (all if nullptr) in buffer
+page_action read_page_action(const uint32_t address,
+			     const uint8_t* buffer,
+			     const uint8_t* mask,
+			     uint8_t* readback,
+			     const uint16_t begin,
+			     const uint16_t end)
+{
+	spipgm::set_clock(load_clock.read);
+	spipgm::wait_device_ready();
+	spipgm::read_program_memory(address + begin, readback, end - begin,
+				    verbose);
+	spipgm::set_clock(load_clock.write);
+	return page_action_for(readback, buffer + begin, end - begin, mask,
+			       begin);
+}
+
+// Write words [begin, end) of page to the single target and verify the
+// bytes of mask (all if nullptr).  A mismatch is first re-read at half
+// the read clock, if the page is still wrong programming is re-entered
+// at half the write clock and the page rewritten (erasing the chip if
+// bits must be set).  Clocks double again after clock_climb_pages
+// clean pages.
+const char* write_verify_page(flash_load_t& flash,
+			      const uint32_t address,
+			      const uint8_t* buffer,
+			      const uint8_t* mask,
+			      const uint16_t begin,
+			      const uint16_t end)
+{
+	write_page(address, buffer, begin, end);
+
+	uint8_t readback[end - begin];
+	page_action action = read_page_action(address, buffer, mask,
+					      readback, begin, end);
+	for (uint8_t retry = 0; action != page_action::unchanged; ++retry)
 	{
-		const bool nl_in_buffer =
-			i8hex_buffer[bytes_in_buffer - 1] == ':';
-		decoder.decode(&i8hex_buffer[0], bytes_in_buffer);
-		if (nl_in_buffer || decoder.done() || decoder.error())
-			break;
+		if (retry == page_verify_retries)
+			return "Page verify failed";
+		Serial.print(F("Verify failed at 0x"));
+		Serial.println(address, HEX);
+		load_clock.clean_pages = 0;
 
-		// read more data
-		bytes_in_buffer = util::serial_read_until_nl(
-			&i8hex_buffer[0],
-			i8hex_buffer_size);
+		if (load_clock.read > min_load_clock)
+		{
+			load_clock.read /= 2;
+			output_load_clock();
+			action = read_page_action(address, buffer, mask,
+						  readback, begin, end);
+			if (action == page_action::unchanged)
+				break; // page was written, reading failed
+		}
 
-	} while (true);
+		if (load_clock.write > min_load_clock)
+			load_clock.write /= 2;
+		output_load_clock();
+		spipgm::wait_device_ready();
+		spipgm::program_disable();
+		if (!spipgm::program_enable(SPISettings(load_clock.write,
+							MSBFIRST, SPI_MODE0),
+					    2, // retries
+					    verbose))
+			return "Unable to re-enable programming";
+		if (action == page_action::erase)
+		{
+			if (flash.merge)
+				return "Page verify failed";
+			erase_target_for_load(flash, 0, true);
+		}
+		write_page(address, buffer, begin, end);
+		action = read_page_action(address, buffer, mask,
+					  readback, begin, end);
+	}
 
-	if (decoder.error())
+	if (++load_clock.clean_pages == clock_climb_pages &&
+	    (load_clock.write < load_clock.max ||
+	     load_clock.read < load_clock.max))
 	{
-		Serial.println(F("I8HEX decode failed:"));
-		Serial.println(decoder.error());
-		perform_load_image = false;
+		load_clock.clean_pages = 0;
+		if (load_clock.write < load_clock.max)
+			load_clock.write *= 2;
+		if (load_clock.read < load_clock.max)
+			load_clock.read *= 2;
+		output_load_clock();
+		spipgm::set_clock(load_clock.write);
 	}
+	return nullptr;
+}
 
-	return decoder.done() || decoder.error();
+// Read page at address from the single target into current and copy
+// it into the decoder's buffer where no bytes were decoded.
+void merge_target_page(const paged::Decoder& decoder, uint8_t* current)
+{
+	spipgm::wait_device_ready();
+	spipgm::read_program_memory(decoder.get_buffer_address_on_target(),
+				    current, decoder.page_size, verbose);
+	for (uint16_t ix = 0; ix < decoder.page_size; ++ix)
+	{
+		if (!decoder.is_decoded(ix))
+			decoder.buffer[ix] = current[ix];
+	}
 }
 
 // called whenever a I8HEX buffer is decoded into raw
-const char* decoded_full_buffer(const I8HEX::Decoder& decoder)
+const char* decoded_full_buffer(image_load_t& load,
+				const paged::Decoder& decoder)
 {
-	if (perform_load_image)
+	if (!load.perform)
+		return nullptr;
+
+	const uint32_t address = decoder.get_buffer_address_on_target();
+	if (address >= load.flash.size)
+		return "Flash address out of range";
+	uint16_t begin = decoder.get_dirty_begin();
+	uint16_t end = decoder.get_dirty_end();
+	uint8_t current[load.flash.merge ? decoder.page_size : 1];
+	if (load.flash.merge)
+		merge_target_page(decoder, current);
+	// bytes the image sets, the others are left as they are on the
+	// target wherever the page was decoded before (or not at all)
+	const size_t mask_bytes = (decoder.page_size + 7) / 8;
+	uint8_t mask[mask_bytes];
+	memcpy(mask, decoder.get_decoded_mask(), mask_bytes);
+	patches::apply(address, decoder.buffer, decoder.page_size, begin, end,
+		       mask);
+	trim_erased_words(decoder.buffer, begin, end);
+	if (load.flash.merge)
 	{
-		spipgm::wait_device_ready();
-		spipgm::load_program_memory(
-			decoder.get_buffer_address_on_target(),
-			decoder.buffer,
-			decoder.page_size,
-			verbose);
-		spipgm::write_program_page(
-			decoder.get_buffer_address_on_target(),
-			verbose);
+		// the chip can't be erased without losing the rest of
+		// the image, so a merge may only clear bits
+		switch (page_action_for(current, decoder.buffer,
+					decoder.page_size))
+		{
+		case page_action::unchanged:
+			++load.flash.pages_unchanged;
+			return nullptr;
+		case page_action::erase:
+			Serial.print(F("Merge sets cleared bits at 0x"));
+			Serial.println(address, HEX);
+			return "Merge needs an erase, load full image instead";
+		default:
+			++load.flash.pages_written;
+			return write_verify_page(load.flash, address,
+						 decoder.buffer, nullptr,
+						 begin, end);
+		}
 	}
+	const uint8_t targets = targets_to_write(load, address,
+						 decoder.buffer, mask,
+						 decoder.page_size);
+	if (gang_loading)
+		return gang_write_page(decoder, mask, targets, begin, end);
+
+	if (targets)
+		return write_verify_page(load.flash, address, decoder.buffer,
+					 mask, begin, end);
 	return nullptr;
 }
 
-void load_image()
+// called for every decoded byte when streaming, the byte is loaded into
+// the target's page buffer straight away (the target has been erased,
+// and the previous page written by streamed_page_end()), bytes must
+// ascend within a page for the page's CRC to be kept running
+const char* streamed_byte(image_load_t& load,
+			  const paged::Decoder& decoder,
+			  const uint32_t address,
+			  uint8_t value)
 {
-	spipgm::powerup_avr();
-	enable_programming(verbose);
+	if (!load.perform)
+		return nullptr;
+	if (address >= load.flash.size)
+		return "Flash address out of range";
 
-	uint32_t sig;
-	uint16_t flash_size;
-	uint16_t page_size;
-	get_signature_flash_page_sizes(sig, flash_size, page_size);
-	perform_load_image = true;
+	uint16_t begin = 0;
+	uint16_t end = 1;
+	patches::apply(address, &value, 1, begin, end);
+	const uint16_t offset =
+		address - decoder.get_buffer_address_on_target();
+	if (!load.stream.started)
+	{
+		load.stream.started = true;
+		load.stream.next = offset;
+		load.stream.crc = 0;
+	}
+	if (offset < load.stream.next)
+		return "Streamed records must ascend within a page";
+	for (; load.stream.next < offset; ++load.stream.next)
+		load.stream.crc = BIN::Decoder::crc16(load.stream.crc, 0xff);
+	load.stream.crc = BIN::Decoder::crc16(load.stream.crc, value);
+	++load.stream.next;
+	spipgm::load_program_byte(address, value, verbose);
+	return nullptr;
+}
 
-	if (flash_size && page_size)
+// called at the end of every streamed page, write the page and compare
+// the CRC of its decoded range read back with that of the bytes
+// streamed into it
+const char* streamed_page_end(image_load_t& load,
+			      const paged::Decoder& decoder)
+{
+	if (!load.perform)
+		return nullptr;
+
+	const uint32_t address = decoder.get_buffer_address_on_target();
+	const uint16_t begin = decoder.get_dirty_begin();
+	const uint16_t end = decoder.get_dirty_end();
+	spipgm::write_program_page(address, verbose);
+	++load.flash.pages_written;
+	spipgm::wait_device_ready();
+
+	uint16_t crc = 0;
+	uint8_t word[2];
+	for (uint16_t offset = begin & ~1; offset < end; offset += 2)
 	{
-		char target_buffer[page_size];
-		I8HEX::Decoder decoder(target_buffer,
-				       page_size,
-				       &decoded_full_buffer);
-		char i8hex_buffer[100];
-		Serial.println(F("Paste image below or upload hex file"));
-		bool done = false;
-		while (!done)
-		{
-			i8hex_buffer[0] = util::serial_read_char_of(":;");
-			if (i8hex_buffer[0] == ':')
+		spipgm::read_program_memory(address + offset, word, 2,
+					    verbose);
+		if (offset >= begin)
+			crc = BIN::Decoder::crc16(crc, word[0]);
+		if (offset + 1 < end)
+			crc = BIN::Decoder::crc16(crc, word[1]);
+	}
+	const bool verified = load.stream.started && crc == load.stream.crc;
+	load.stream = stream_page_t();
+	return verified ? nullptr : "Streamed page verify failed";
+}
+
+// called whenever a I8HEX buffer of the ;eeprom section is decoded,
+// only bytes the image sets which differ from the target's EEPROM are
+// written, so a partial section leaves the rest of the page as it is
+const char* decoded_full_eeprom_buffer(image_load_t& load,
+				       const paged::Decoder& decoder)
+{
+	if (!load.perform)
+		return nullptr;
+
+	const uint16_t address = decoder.get_buffer_address_on_target();
+	const uint8_t begin = decoder.get_dirty_begin();
+	const uint8_t end = decoder.get_dirty_end();
+	if (address >= load.eeprom.size)
+		return "EEPROM address out of range";
+
+	for_each_target([&](uint8_t) {
+		uint8_t current[end - begin];
+		spipgm::wait_device_ready();
+		spipgm::read_eeprom_memory(address + begin, current,
+					   end - begin, verbose);
+		bool changed = false;
+		for (uint8_t ix = begin; ix < end; ++ix)
+		{
+			if (!decoder.is_decoded(ix) ||
+			    current[ix - begin] == decoder.buffer[ix])
+				continue;
+			if (load.eeprom.page_mode)
 			{
-				done = process_i8hex_directive(
-					&i8hex_buffer[0],
-					sizeof(i8hex_buffer),
-					flash_size,
-					decoder);
+				// only loaded bytes of the page are written
+				spipgm::load_eeprom_page(address + ix,
+							 decoder.buffer + ix,
+							 1, verbose);
 			}
 			else
 			{
-				done = process_load_directive(sig);
+				spipgm::wait_device_ready();
+				spipgm::write_eeprom_byte(address + ix,
+							  decoder.buffer[ix],
+							  verbose);
 			}
+			changed = true;
 		}
+		if (!changed)
+		{
+			++load.eeprom.pages_unchanged;
+			return;
+		}
+		if (load.eeprom.page_mode)
+			spipgm::write_eeprom_page(address, verbose);
+		++load.eeprom.pages_written;
+	});
+	return nullptr;
+}
 
-		drain_serial();
+// sinks of the decoders of a load, calling the functions above with the
+// load's state
+struct flash_page_sink
+{
+	image_load_t& load;
+
+	const char* operator()(const paged::Decoder& decoder)
+	{
+		return decoded_full_buffer(load, decoder);
 	}
+};
 
-	perform_load_image = false;
-	spipgm::program_disable();
+struct flash_stream_sink
+{
+	image_load_t& load;
+
+	const char* operator()(const paged::Decoder& decoder,
+			       const uint32_t address,
+			       const uint8_t value)
+	{
+		return streamed_byte(load, decoder, address, value);
+	}
+
+	const char* operator()(const paged::Decoder& decoder)
+	{
+		return streamed_page_end(load, decoder);
+	}
+};
+
+struct eeprom_page_sink
+{
+	image_load_t& load;
+
+	const char* operator()(const paged::Decoder& decoder)
+	{
+		return decoded_full_eeprom_buffer(load, decoder);
+	}
+};
+
+#ifdef I8HEX_DECODER_STATS
+void output_decoder_stats(const I8HEX::Decoder::stats_type& stats)
+{
+	Serial.print(F("Records "));
+	Serial.print(stats.records);
+	Serial.print(F(", payload bytes "));
+	Serial.println(stats.payload_bytes);
+	Serial.print(F("Pages flushed full "));
+	Serial.print(stats.full_pages);
+	Serial.print(F(", partial "));
+	Serial.print(stats.partial_pages);
+	Serial.print(F(", by address jumps "));
+	Serial.println(stats.address_flushes);
+	Serial.print(F("Pages merged in cache "));
+	Serial.print(stats.pages_merged);
+	Serial.print(F(", revisited "));
+	Serial.println(stats.pages_revisited);
+}
+#endif
+
+// Read I8HEX image and directives from serial and load them into target
+// (or live gang sockets), return true if whole image was loaded.
+bool load_image_from_serial(const uint32_t sig,
+			    const uint32_t flash_size,
+			    const uint16_t page_size,
+			    const devices::device_pgm_t* dev_ptr,
+			    const bool streaming = false)
+{
+	image_load_t load = image_load_t();
+	load.perform = true;
+	load.flash.size = flash_size;
+	if (streaming)
+		load.flash.erased = 1;
+	patches::clear();
+	uint8_t eeprom_page_size = 4; // decode size when written bytewise
+	if (dev_ptr)
+	{
+		load.eeprom.size = dev_ptr->get_eeprom_size();
+		load.eeprom.page_mode = dev_ptr->get_eeprom_page_size();
+		if (load.eeprom.page_mode)
+			eeprom_page_size = dev_ptr->get_eeprom_page_size();
+	}
+
+	// no page is cached when streaming, streamed pages are verified by
+	// CRC
+	uint8_t cache_pages = 1;
+	if (!streaming && page_size < flash_cache_bytes)
+		cache_pages = flash_cache_bytes / page_size;
+	if (cache_pages > I8HEX::Decoder::max_cache_pages)
+		cache_pages = I8HEX::Decoder::max_cache_pages;
+	char target_buffer[streaming ? 1 : cache_pages * page_size];
+	flash_page_sink page_sink{load};
+	flash_stream_sink stream_sink{load};
+	I8HEX::Decoder flash_decoder = streaming ?
+		I8HEX::Decoder(page_size, stream_sink) :
+		I8HEX::Decoder(target_buffer,
+			       page_size,
+			       page_sink,
+			       cache_pages);
+	// bytes decoded into target_buffer, only those are loaded
+	uint8_t decoded_mask[streaming ?
+			     1 : cache_pages * ((page_size + 7) / 8)];
+	if (!streaming)
+		flash_decoder.set_decoded_mask(decoded_mask);
+	char eeprom_buffer[eeprom_page_size];
+	eeprom_page_sink eeprom_sink{load};
+	I8HEX::Decoder eeprom_decoder(eeprom_buffer,
+				      eeprom_page_size,
+				      eeprom_sink);
+	// bytes decoded into eeprom_buffer, only those are written
+	uint8_t eeprom_decoded_mask[(eeprom_page_size + 7) / 8];
+	eeprom_decoder.set_decoded_mask(eeprom_decoded_mask);
+	I8HEX::Decoder* decoder = &flash_decoder;
+	// S-records are decoded into the pages of the I8HEX decoders
+	SREC::Decoder flash_srec_decoder(flash_decoder);
+	SREC::Decoder eeprom_srec_decoder(eeprom_decoder);
+	char record_buffer[record_buffer_size];
+	Serial.println(F("Paste image below or upload hex, S-record "
+			 "or ;bin image"));
+	bool done = false;
+	while (!done)
+	{
+		record_buffer[0] = util::serial_read_char_of(":S;");
+		if (record_buffer[0] == ':')
+		{
+			done = process_text_records(
+				load,
+				&record_buffer[0],
+				sizeof(record_buffer),
+				*decoder,
+				F("I8HEX"));
+		}
+		else if (record_buffer[0] == 'S')
+		{
+			done = process_text_records(
+				load,
+				&record_buffer[0],
+				sizeof(record_buffer),
+				decoder == &flash_decoder ?
+				flash_srec_decoder : eeprom_srec_decoder,
+				F("SREC"));
+		}
+		else
+		{
+			done = process_load_directive(load,
+						      sig,
+						      decoder,
+						      eeprom_decoder);
+		}
+
+		if (decoder == &eeprom_decoder && eeprom_decoder.done() &&
+		    !eeprom_decoder.error())
+		{
+			// end of ;eeprom section
+			Serial.print(F("EEPROM pages written "));
+			Serial.print(load.eeprom.pages_written);
+			Serial.print(F(", unchanged "));
+			Serial.println(load.eeprom.pages_unchanged);
+			decoder = &flash_decoder;
+			// backups put the section after the flash image,
+			// in which case it ends the load
+			done = flash_decoder.done();
+			// the last EEPROM write completes before streamed
+			// bytes are loaded (without polling) or the load ends
+			for_each_target([](uint8_t) {
+				spipgm::wait_device_ready();
+			});
+		}
+		else if (done && load.perform && flash_decoder.done() &&
+			 !flash_decoder.error() && load.eeprom.size &&
+			 !eeprom_decoder.done())
+		{
+			// flash image complete, an ;eeprom section or other
+			// directive may still follow it
+			done = !directive_follows();
+		}
+	}
+
+	drain_serial();
+
+	Serial.print(F("Flash pages written "));
+	Serial.print(load.flash.pages_written);
+	Serial.print(F(", unchanged "));
+	Serial.print(load.flash.pages_unchanged);
+	Serial.println(load.flash.erased ? F(", chip erased")
+		       : load.flash.merge ? F(", merged")
+					  : F(", no erase needed"));
+#ifdef I8HEX_DECODER_STATS
+	output_decoder_stats(flash_decoder.get_stats());
+#endif
+	for_each_target([&](const uint8_t socket) {
+		if (load.flash.reload & 1 << socket)
+		{
+			Serial.println(F("Chip erased after pages were loaded"
+					 " - load image again"));
+			target_failed(socket);
+		}
+	});
+
+	bool loaded = flash_decoder.done() && !flash_decoder.error() &&
+		(gang_loading ? gang_live : !load.flash.reload);
+	if (loaded && !patches::all_applied())
+	{
+		Serial.println(F("Patch address not within loaded pages"));
+		loaded = false;
+	}
+	if (loaded)
+		patches::commit();
+	return loaded;
+}
+
+void load_image()
+{
+	spipgm::powerup_avr();
+	const uint32_t clock_rate = enable_programming(verbose);
+	load_clock = load_clock_t{clock_rate, clock_rate, clock_rate, 0};
+
+	uint32_t sig;
+	uint32_t flash_size;
+	uint16_t page_size;
+	const devices::device_pgm_t* dev_ptr =
+		get_signature_flash_page_sizes(sig, flash_size, page_size);
+
+	if (flash_size && page_size)
+		load_image_from_serial(sig, flash_size, page_size, dev_ptr);
+
+	spipgm::program_disable();
+	spipgm::powerdown_avr();
+}
+
+// Erase target and stream image from serial into it, each decoded byte
+// is loaded into the target as it arrives without a page cache.
+void stream_image()
+{
+	spipgm::powerup_avr();
+	enable_programming(verbose);
+
+	uint32_t sig;
+	uint32_t flash_size;
+	uint16_t page_size;
+	const devices::device_pgm_t* dev_ptr =
+		get_signature_flash_page_sizes(sig, flash_size, page_size);
+
+	if (flash_size && page_size)
+	{
+		Serial.print(F("erasing..."));
+		spipgm::wait_device_ready();
+		spipgm::perform_chip_erase(verbose);
+		spipgm::wait_device_ready();
+		Serial.println(F("done"));
+		load_image_from_serial(sig, flash_size, page_size, dev_ptr,
+				       true);
+	}
+
+	spipgm::program_disable();
+	spipgm::powerdown_avr();
+}
+
+// copy page at address of golden image into buffer, padding beyond
+// the end of the image with 0xff
+void read_golden_page(const golden_images::image_pgm_t* image,
+		      const uint32_t address,
+		      uint8_t* buffer,
+		      const uint16_t page_size)
+{
+	const uint32_t size = image->get_size();
+	uint16_t bytes = 0;
+	if (address < size)
+		bytes = size - address < page_size ? size - address : page_size;
+	memcpy_P(buffer, image->get_data() + address, bytes);
+	memset(buffer + bytes, 0xff, page_size - bytes);
+	uint16_t begin = 0;
+	uint16_t end = page_size;
+	patches::apply(address, buffer, page_size, begin, end);
+}
+
+// write golden image into target (programming enabled) and verify it,
+// return true if successful
+bool program_golden_image(const golden_images::image_pgm_t* image)
+{
+	uint32_t sig;
+	uint32_t flash_size;
+	uint16_t page_size;
+	get_signature_flash_page_sizes(sig, flash_size, page_size);
+	if (sig != image->get_expected_signature())
+	{
+		Serial.print(F("Signature mismatch, image is for "));
+		Serial.println(image->get_expected_signature(), HEX);
+		return false;
+	}
+	const uint32_t size = image->get_size();
+	if (!flash_size || !page_size || size > flash_size)
+	{
+		Serial.println(F("Image does not fit target"));
+		return false;
+	}
+
+	patches::clear();
+	if (image->get_patch_length())
+		patches::add(image->get_patch_address(),
+			     image->get_patch_length(),
+			     image->get_patch_increment(),
+			     image->get_patch_initial());
+
+	// pre-pass deciding if a chip erase is needed at all
+	uint8_t page[page_size];
+	uint8_t readback[page_size];
+	bool erase = false;
+	for (uint32_t address = 0; address < size && !erase;
+	     address += page_size)
+	{
+		read_golden_page(image, address, page, page_size);
+		spipgm::read_program_memory(address, readback, page_size,
+					    verbose);
+		erase = page_action_for(readback, page, page_size) ==
+			page_action::erase;
+	}
+	if (erase)
+	{
+		spipgm::wait_device_ready();
+		spipgm::perform_chip_erase(verbose);
+	}
+
+	uint16_t pages_written = 0;
+	uint16_t pages_unchanged = 0;
+	for (uint32_t address = 0; address < size; address += page_size)
+	{
+		read_golden_page(image, address, page, page_size);
+		bool write = !is_erased(page, page_size);
+		if (!erase)
+		{
+			spipgm::wait_device_ready();
+			spipgm::read_program_memory(address, readback,
+						    page_size, verbose);
+			write = page_action_for(readback, page, page_size) ==
+				page_action::write;
+		}
+		if (write)
+		{
+			uint16_t begin = 0;
+			uint16_t end = page_size;
+			trim_erased_words(page, begin, end);
+			write_page(address, page, begin, end);
+			++pages_written;
+		}
+		else
+		{
+			++pages_unchanged;
+		}
+	}
+	spipgm::wait_device_ready();
+
+	Serial.print(F("Flash pages written "));
+	Serial.print(pages_written);
+	Serial.print(F(", unchanged "));
+	Serial.print(pages_unchanged);
+	Serial.println(erase ? F(", chip erased") : F(", no erase needed"));
+
+	for (uint32_t address = 0; address < size; address += page_size)
+	{
+		read_golden_page(image, address, page, page_size);
+		spipgm::read_program_memory(address, readback, page_size,
+					    verbose);
+		if (memcmp(page, readback, page_size))
+		{
+			Serial.print(F("Verify failed at 0x"));
+			Serial.println(address, HEX);
+			return false;
+		}
+	}
+
+	if (image->get_has_fuses())
+	{
+		const spipgm::fuses_t fuses(pgm_read_byte(&image->lock),
+					    pgm_read_byte(&image->low),
+					    pgm_read_byte(&image->high),
+					    pgm_read_byte(&image->ext));
+		if (!spipgm::write_verify_fuses(fuses, verbose))
+			return false;
+	}
+	patches::commit();
+	return true;
+}
+
+// prompt for a golden image, return nullptr if there are none
+const golden_images::image_pgm_t* select_golden_image()
+{
+	const uint8_t count = golden_images::count();
+	if (!count)
+	{
+		Serial.println(F("No golden images built in"));
+		return nullptr;
+	}
+
+	char options[count + 1];
+	for (uint8_t ix = 0; ix < count; ++ix)
+	{
+		const golden_images::image_pgm_t* image =
+			golden_images::image(ix);
+		options[ix] = '0' + ix;
+		Serial.print(ix);
+		Serial.print(F(" - "));
+		Serial.print(util::FF(&image->image_name));
+		Serial.print(F("  ("));
+		Serial.print(image->get_expected_signature(), HEX);
+		Serial.print(F(", "));
+		Serial.print(image->get_size());
+		Serial.println(F(" bytes)"));
+	}
+	options[count] = 0;
+
+	return golden_images::image(util::serial_read_char_of(options) - '0');
+}
+
+void golden_image_load()
+{
+	const golden_images::image_pgm_t* image = select_golden_image();
+	if (!image)
+		return;
+
+	spipgm::powerup_avr();
+	enable_programming(verbose);
+	const bool programmed = program_golden_image(image);
+	spipgm::program_disable();
 	spipgm::powerdown_avr();
+	Serial.println(programmed ? F("## done ##") : F("***failed***"));
+}
+
+// Return true if a target responds to programming enable with a valid
+// signature, it is then left in reset with programming disabled (each
+// SPI.begin() is matched by an SPI.end()).  Each attempt is short with
+// a slow clock so that targets running from any clock respond.
+bool production_target_present()
+{
+	spipgm::powerup_avr();
+	bool present = false;
+	if (spipgm::program_enable(SPISettings(125000, MSBFIRST, SPI_MODE0),
+				   0, // retries
+				   false))
+	{
+		const uint32_t sig = spipgm::read_signature(false);
+		present = sig != 0 && sig != 0xffffff;
+		spipgm::program_disable();
+	}
+	if (!present)
+		spipgm::powerdown_avr();
+	return present;
+}
+
+void production_leds(const bool busy, const bool pass, const bool fail)
+{
+	digitalWrite(production_busy_led, busy ? HIGH : LOW);
+	digitalWrite(production_pass_led, pass ? HIGH : LOW);
+	digitalWrite(production_fail_led, fail ? HIGH : LOW);
+}
+
+// Wait production_poll_ms between target detection attempts until the
+// target's presence is as wanted, return false if operator pressed q.
+bool production_wait_for_target(const bool present)
+{
+	if (!present)
+		// leave target in reset while waiting for removal
+		spipgm::powerup_avr();
+	while (true)
+	{
+		if (production_target_present() == present)
+			return true;
+		const unsigned long start = millis();
+		while (millis() - start < production_poll_ms)
+			if (Serial.available() && Serial.read() == 'q')
+				return false;
+	}
+}
+
+// Program the selected golden image into every target inserted until
+// q is pressed, the operator only swaps boards.
+void production_run()
+{
+	const golden_images::image_pgm_t* image = select_golden_image();
+	if (!image)
+		return;
+
+	pinMode(production_busy_led, OUTPUT);
+	pinMode(production_pass_led, OUTPUT);
+	pinMode(production_fail_led, OUTPUT);
+	production_leds(false, false, false);
+	drain_serial();
+
+	Serial.println(F("Production mode - insert targets, q to quit"));
+	uint16_t passed = 0;
+	uint16_t failed = 0;
+	while (production_wait_for_target(true))
+	{
+		delay(production_settle_ms);
+		production_leds(true, false, false);
+		spipgm::powerup_avr();
+		enable_programming(verbose);
+		const bool programmed = program_golden_image(image);
+		spipgm::program_disable();
+		spipgm::powerdown_avr();
+
+		if (programmed)
+			++passed;
+		else
+			++failed;
+		production_leds(false, programmed, !programmed);
+		Serial.print(programmed ? F("PASS") : F("FAIL"));
+		Serial.print(F("  passed "));
+		Serial.print(passed);
+		Serial.print(F(" failed "));
+		Serial.println(failed);
+
+		Serial.println(F("Remove target"));
+		if (!production_wait_for_target(false))
+			break;
+		production_leds(false, false, false);
+	}
+
+	// release a target left in reset by q while waiting for removal
+	spipgm::powerdown_avr();
+	production_leds(false, false, false);
+	Serial.println(F("Production mode ended"));
+}
+
+void gang_load_image()
+{
+	spipgm::powerup_avr();
+	gang::begin();
+
+	uint32_t clock_rate;
+	const uint8_t enabled = gang::enable_programming(gang_sockets,
+							 clock_rate, verbose);
+	gang_live = enabled;
+	gang_failed = gang_sockets & ~gang_live;
+
+	if (gang_live)
+	{
+		uint8_t first = 0;
+		while (!(gang_live & 1 << first))
+			++first;
+		gang::select(first);
+
+		uint32_t sig;
+		uint32_t flash_size;
+		uint16_t page_size;
+		const devices::device_pgm_t* dev_ptr =
+			get_signature_flash_page_sizes(sig, flash_size,
+						       page_size);
+
+		gang_loading = true;
+		for_each_target([&](const uint8_t socket) {
+			if (spipgm::read_signature(verbose) != sig)
+			{
+				Serial.print(F("Signature mismatch, "));
+				target_failed(socket);
+			}
+		});
+
+		bool loaded = false;
+		if (gang_live && flash_size && page_size)
+			loaded = load_image_from_serial(sig, flash_size,
+							page_size, dev_ptr);
+		gang_loading = false;
+		if (!loaded)
+		{
+			gang_failed |= gang_live;
+			gang_live = 0;
+		}
+	}
+
+	gang::deselect();
+	Serial.print(F("Gang sockets passed: "));
+	gang::output_sockets(gang_live);
+	Serial.print(F(" failed: "));
+	gang::output_sockets(gang_failed);
+	Serial.println();
+
+	if (enabled)
+		spipgm::program_disable();
+	spipgm::powerdown_avr();
+}
+
+// Copy flash and fuses of the target in gang socket source to the one
+// in socket destination (both with programming enabled), page by page
+// at SPI speed without the host.  Return true if the destination
+// verified.
+bool copy_target(const uint8_t source, const uint8_t destination)
+{
+	gang::select(source);
+	uint32_t sig;
+	uint32_t flash_size;
+	uint16_t page_size;
+	get_signature_flash_page_sizes(sig, flash_size, page_size);
+	const spipgm::fuses_t fuses = spipgm::read_fuses(verbose);
+	if (!flash_size || !page_size)
+		return false;
+
+	gang::select(destination);
+	if (spipgm::read_signature(verbose) != sig)
+	{
+		Serial.println(F("Destination signature differs"));
+		return false;
+	}
+
+	Serial.print(F("erasing destination..."));
+	spipgm::wait_device_ready();
+	spipgm::perform_chip_erase(verbose);
+	spipgm::wait_device_ready();
+	Serial.println(F("done"));
+
+	uint8_t page[page_size];
+	uint8_t readback[page_size];
+	uint16_t pages_copied = 0;
+	// source and destination each have their own extended address
+	// byte loaded, gang::select() makes the next access reissue it so
+	// pages above 128K are read and written in the right segment
+	for (uint32_t address = 0; address < flash_size; address += page_size)
+	{
+		gang::select(source);
+		spipgm::read_program_memory(address, page, page_size, verbose);
+		if (is_erased(page, page_size))
+			continue; // destination is already erased
+
+		gang::select(destination);
+		spipgm::load_program_memory(address, page, page_size, verbose);
+		spipgm::write_program_page(address, verbose);
+		spipgm::wait_device_ready();
+		spipgm::read_program_memory(address, readback, page_size,
+					    verbose);
+		if (memcmp(page, readback, page_size))
+		{
+			Serial.print(F("Verify failed at 0x"));
+			Serial.println(address, HEX);
+			return false;
+		}
+		++pages_copied;
+	}
+	Serial.print(F("Pages copied "));
+	Serial.println(pages_copied);
+
+	// write_fuses writes the lock bits last
+	gang::select(destination);
+	return spipgm::write_verify_fuses(fuses, verbose);
+}
+
+// Enable programming of the source and destination sockets and clone
+// source to destination, return true if the destination verified.
+bool clone_target(const uint8_t source, const uint8_t destination)
+{
+	uint32_t clock_rate;
+	const uint8_t sockets = 1 << source | 1 << destination;
+	const uint8_t enabled = gang::enable_programming(sockets, clock_rate,
+							 verbose);
+	const bool cloned = enabled == sockets &&
+		copy_target(source, destination);
+	// programming was enabled once whichever way the copy ended
+	if (enabled)
+		spipgm::program_disable();
+	return cloned;
+}
+
+void clone_menu()
+{
+	char options[gang::max_sockets + 1];
+	for (uint8_t socket = 0; socket < gang::max_sockets; ++socket)
+		options[socket] = '1' + socket;
+	options[gang::max_sockets] = 0;
+
+	Serial.println(F("Select source socket"));
+	const uint8_t source = util::serial_read_char_of(options) - '1';
+	Serial.println(F("Select destination socket"));
+	const uint8_t destination = util::serial_read_char_of(options) - '1';
+	if (source == destination)
+	{
+		Serial.println(F("Source and destination must differ"));
+		return;
+	}
+
+	spipgm::powerup_avr();
+	gang::begin();
+	const bool cloned = clone_target(source, destination);
+	gang::deselect();
+	spipgm::powerdown_avr();
+
+	Serial.print(F("Clone of socket "));
+	Serial.print(source + 1);
+	Serial.print(F(" to socket "));
+	Serial.print(destination + 1);
+	Serial.println(cloned ? F(" passed") : F(" FAILED"));
+}
+
+void gang_menu()
+{
+	char options[gang::max_sockets + 3];
+	for (uint8_t socket = 0; socket < gang::max_sockets; ++socket)
+		options[socket] = '1' + socket;
+	strcpy(&options[gang::max_sockets], "lcq");
+
+	bool done = false;
+	while (!done)
+	{
+		Serial.println(F("=== Gang ==="));
+		Serial.print(F("selected sockets: "));
+		gang::output_sockets(gang_sockets);
+		Serial.println();
+		Serial.print(F("1-"));
+		Serial.print(gang::max_sockets);
+		Serial.println(F(" - toggle socket"));
+		Serial.println(F("l - write flash from serial "
+				 "to selected sockets"));
+		Serial.println(F("c - clone flash and fuses "
+				 "from one socket to another"));
+		Serial.println(F("q - quit gang menu"));
+
+		char c = util::serial_read_char_of(options);
+		Serial.println();
+		switch (c)
+		{
+		case 'l' :
+			gang_load_image();
+			break;
+		case 'c' :
+			clone_menu();
+			break;
+		case 'q' :
+			done = true;
+			break;
+		default:
+			gang_sockets ^= 1 << (c - '1');
+			break;
+		}
+	}
 }
 
 void high_voltage_fuses_reset()
 {
+	target_clock::stop(); // its pin is VCC of the target
 	spipgm::fuses_t fuses{};
 	bool inverted_high_voltage_level_shifter = true;
 	uint8_t crude_delay = 0x10;
@@ -589,6 +2127,40 @@ void high_voltage_fuses_reset()
 	}
 }
 
+void patch_counters_menu()
+{
+	patches::output_counters();
+	Serial.println(F("r - reset counters to patch initial values"));
+	Serial.println(F("q - quit patch counters menu"));
+	if (util::serial_read_char_of("rq") == 'r')
+	{
+		patches::reset_counters();
+		Serial.println(F("Counters reset"));
+	}
+}
+
+void target_clock_menu()
+{
+	Serial.print(F("Clock output on pin "));
+	Serial.print(target_clock::pin);
+	Serial.println(F(" for target XTAL1"));
+	Serial.println(F("8 - 8 MHz"));
+	Serial.println(F("4 - 4 MHz"));
+	Serial.println(F("2 - 2 MHz"));
+	Serial.println(F("1 - 1 MHz"));
+	Serial.println(F("o - off"));
+	const char c = util::serial_read_char_of("8421o");
+	target_clock::start(c == 'o' ? 0 : (c - '0') * 1000000ul);
+}
+
+void display_write_busy_times()
+{
+	spipgm::output_busy_times();
+	Serial.println(F("clear busy times? (y/n)"));
+	if (util::serial_read_char_of("yn") == 'y')
+		spipgm::clear_busy_times();
+}
+
 void loop()
 {
 	Serial.println(F("=== Main menu ==="));
@@ -596,14 +2168,31 @@ void loop()
 	Serial.print(verbose ? 'Y' : 'N');
 	Serial.println(F(")"));
 	Serial.println(F("s - display device signature"));
+	Serial.print(F("c - target clock output (current "));
+	if (target_clock::frequency())
+	{
+		Serial.print(target_clock::frequency());
+		Serial.println(F(" Hz)"));
+	}
+	else
+	{
+		Serial.println(F("off)"));
+	}
 	Serial.println(F("f - read/write fuses"));
 	Serial.println(F("b - read flash (backup) to serial"));
-	Serial.println(F("e - chip erase (sometimes required before load)"));
+	Serial.println(F("e - chip erase (load erases when required)"));
 	Serial.println(F("l - write flash from serial (load target)"));
+	Serial.println(F("m - stream flash from serial "
+			 "(erases first, no page buffer)"));
+	Serial.println(F("g - gang programming of several targets"));
+	Serial.println(F("p - write golden image from program memory"));
+	Serial.println(F("r - production run of golden image"));
+	Serial.println(F("n - patch counters (serial numbers)"));
 	Serial.println(
 		F("z - zap fuses using high voltage serial programming"));
+	Serial.println(F("t - display write busy times"));
 
-	char c = util::serial_read_char_of("vsfbelz");
+	char c = util::serial_read_char_of("vscfbelmgprnzt");
 	Serial.println();
 	switch (c)
 	{
@@ -625,8 +2214,29 @@ void loop()
 	case 'l' :
 		load_image();
 		break;
+	case 'm' :
+		stream_image();
+		break;
+	case 'g' :
+		gang_menu();
+		break;
+	case 'p' :
+		golden_image_load();
+		break;
+	case 'r' :
+		production_run();
+		break;
+	case 'n' :
+		patch_counters_menu();
+		break;
+	case 'c' :
+		target_clock_menu();
+		break;
 	case 'z' :
 		high_voltage_fuses_reset();
 		break;
+	case 't' :
+		display_write_busy_times();
+		break;
 	}
 }
@@ -3,55 +3,98 @@
 
 namespace
 {
-	const PROGMEM char attiny25_name[] = "Attiny25";
-	const PROGMEM devices::device_pgm_t attiny25 = {
-		attiny25_name,            // device name
-		0x1E910B,                 // device signature
-		2048,                     // flash size
-		32                        // page size
-	};
+#define DEVICE(id, name, ...) const PROGMEM char id##_name[] = name;
+#include"devices.def"
+#undef DEVICE
 
-	const PROGMEM char attiny45_name[] = "Attiny45";
-	const PROGMEM devices::device_pgm_t attiny45 = {
-		attiny45_name,            // device name
-		0x1E920B,                 // device signature
-		4096,                     // flash size
-		64                        // page size
+	const PROGMEM devices::device_pgm_t device_table[] = {
+#define DEVICE(id, name, ...) {id##_name, __VA_ARGS__},
+#include"devices.def"
+#undef DEVICE
 	};
 
-	const PROGMEM char attiny85_name[] = "ATtiny85";
-	const PROGMEM devices::device_pgm_t attiny85 = {
-		attiny85_name,            // device name
-		0x1E930B,                 // device signature
-		8192,                     // flash size
-		64                        // page size
-	};
+	constexpr size_t device_count =
+		sizeof(device_table) / sizeof(device_table[0]);
 
-	const PROGMEM devices::device_pgm_t* const device_ptr_array[] = {
-		&attiny25,
-		&attiny45,
-		&attiny85
+	static_assert(device_count < 256,
+		      "too many devices, must be less than 256");
+
+	constexpr uint32_t device_signatures[] = {
+#define DEVICE(id, name, signature, ...) signature,
+#include"devices.def"
+#undef DEVICE
 	};
 
-	const PROGMEM uint8_t device_count =
-		sizeof(device_ptr_array) / sizeof(device_ptr_array[0]);
+	constexpr bool sorted_by_signature()
+	{
+		for (size_t ix = 1; ix < device_count; ++ix)
+			if (device_signatures[ix - 1] >= device_signatures[ix])
+				return false;
+		return true;
+	}
+
+	static_assert(sorted_by_signature(),
+		      "devices.def must be sorted by signature "
+		      "without duplicates");
+
+	// fuse presets from the datasheets, grouped by device
+	const PROGMEM char tiny_1mhz_name[] = "1 MHz internal (factory)";
+	const PROGMEM char tiny_8mhz_name[] = "8 MHz internal, BOD 2.7V";
+	const PROGMEM char tiny_16mhz_pll_name[] =
+		"16 MHz PLL, BOD 2.7V, EESAVE";
+	const PROGMEM char mega_1mhz_name[] = "1 MHz internal (factory)";
+	const PROGMEM char mega_8mhz_name[] = "8 MHz internal, BOD 2.7V";
+	const PROGMEM char mega_16mhz_name[] =
+		"16 MHz crystal, BOD 2.7V";
+	const PROGMEM char mega_16mhz_boot_name[] =
+		"16 MHz crystal, 4K word bootloader, BOD 2.7V";
 
-	static_assert(
-		sizeof(device_ptr_array) / sizeof(device_ptr_array[0]) < 256,
-		"too many devices, must be less than 256");
+	const PROGMEM devices::fuse_preset_pgm_t fuse_presets[] = {
+		// name                sig       low   high  ext
+		{tiny_1mhz_name,       0x1E9108, 0x62, 0xDF, 0xFF},
+		{tiny_8mhz_name,       0x1E9108, 0xE2, 0xDD, 0xFF},
+		{tiny_16mhz_pll_name,  0x1E9108, 0xF1, 0xD5, 0xFF},
+		{tiny_1mhz_name,       0x1E9206, 0x62, 0xDF, 0xFF},
+		{tiny_8mhz_name,       0x1E9206, 0xE2, 0xDD, 0xFF},
+		{tiny_16mhz_pll_name,  0x1E9206, 0xF1, 0xD5, 0xFF},
+		{tiny_1mhz_name,       0x1E930B, 0x62, 0xDF, 0xFF},
+		{tiny_8mhz_name,       0x1E930B, 0xE2, 0xDD, 0xFF},
+		{tiny_16mhz_pll_name,  0x1E930B, 0xF1, 0xD5, 0xFF},
+		{mega_1mhz_name,       0x1E9705, 0x62, 0x99, 0xFF},
+		{mega_8mhz_name,       0x1E9705, 0xE2, 0xD9, 0xFD},
+		{mega_16mhz_name,      0x1E9705, 0xF7, 0xD9, 0xFD},
+		{mega_1mhz_name,       0x1E9801, 0x62, 0x99, 0xFF},
+		{mega_8mhz_name,       0x1E9801, 0xE2, 0xD9, 0xFD},
+		{mega_16mhz_boot_name, 0x1E9801, 0xFF, 0xD8, 0xFD}
+	};
 }
 
 const devices::device_pgm_t* devices::device_for_signature(uint32_t sig)
 {
-	for (int i = 0; i < pgm_read_byte(&device_count); ++i)
+	uint8_t low = 0;
+	uint8_t high = device_count;
+	while (low < high)
 	{
-		const device_pgm_t* dp =
-			reinterpret_cast<const devices::device_pgm_t*>(
-				pgm_read_ptr(&device_ptr_array[i]));
-
-		if (sig == pgm_read_dword(&dp->expected_signature))
-			return dp;
+		const uint8_t mid = (low + high) / 2;
+		const uint32_t mid_sig = device_table[mid].get_expected_signature();
+		if (mid_sig < sig)
+			low = mid + 1;
+		else if (mid_sig > sig)
+			high = mid;
+		else
+			return &device_table[mid];
 	}
 
 	return nullptr;
 }
+
+const devices::fuse_preset_pgm_t* devices::fuse_preset_for_signature(
+	uint32_t sig,
+	uint8_t index)
+{
+	for (const fuse_preset_pgm_t& preset : fuse_presets)
+		if (preset.get_signature() == sig && !index--)
+			return &preset;
+
+	return nullptr;
+}
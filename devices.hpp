@@ -6,33 +6,143 @@
 
 namespace devices
 {
-	// target device details - must reside in program memory
+	// target device details - must reside in program memory,
+	// the table is generated from devices.def
 	struct device_pgm_t
 	{
 		const char*    device_name;
 		const uint32_t expected_signature;
-		const uint16_t flash_size;
+		const uint32_t flash_size;
 		const uint16_t page_size;
+		const uint16_t eeprom_size;
+		// EEPROM page size, 0 if EEPROM can only be written bytewise
+		const uint8_t  eeprom_page_size;
+		// maximum write delays in 100us units from the serial
+		// programming characteristics of the datasheet
+		const uint8_t  twd_flash;
+		const uint8_t  twd_eeprom;
+		const uint8_t  twd_erase;
+		const uint8_t  twd_fuse;
+		// true if device supports the Poll RDY/BSY instruction
+		const bool     rdy_bsy_poll;
+		// implemented fuse bits, others read back unpredictably
+		const uint8_t  fuse_mask_lock;
+		const uint8_t  fuse_mask_low;
+		const uint8_t  fuse_mask_high;
+		const uint8_t  fuse_mask_ext;
 
 		uint32_t get_expected_signature() const
 		{
 			return pgm_read_dword(&expected_signature);
 		}
 
-		uint16_t get_flash_size() const
+		uint32_t get_flash_size() const
 		{
-			return pgm_read_word(&flash_size);
+			return pgm_read_dword(&flash_size);
 		}
 
 		uint16_t get_page_size() const
 		{
 			return pgm_read_word(&page_size);
 		}
+
+		uint16_t get_eeprom_size() const
+		{
+			return pgm_read_word(&eeprom_size);
+		}
+
+		uint8_t get_eeprom_page_size() const
+		{
+			return pgm_read_byte(&eeprom_page_size);
+		}
+
+		// write delays in microseconds
+		uint16_t get_twd_flash() const
+		{
+			return pgm_read_byte(&twd_flash) * 100u;
+		}
+
+		uint16_t get_twd_eeprom() const
+		{
+			return pgm_read_byte(&twd_eeprom) * 100u;
+		}
+
+		uint16_t get_twd_erase() const
+		{
+			return pgm_read_byte(&twd_erase) * 100u;
+		}
+
+		uint16_t get_twd_fuse() const
+		{
+			return pgm_read_byte(&twd_fuse) * 100u;
+		}
+
+		bool get_rdy_bsy_poll() const
+		{
+			return pgm_read_byte(&rdy_bsy_poll);
+		}
+
+		uint8_t get_fuse_mask_lock() const
+		{
+			return pgm_read_byte(&fuse_mask_lock);
+		}
+
+		uint8_t get_fuse_mask_low() const
+		{
+			return pgm_read_byte(&fuse_mask_low);
+		}
+
+		uint8_t get_fuse_mask_high() const
+		{
+			return pgm_read_byte(&fuse_mask_high);
+		}
+
+		uint8_t get_fuse_mask_ext() const
+		{
+			return pgm_read_byte(&fuse_mask_ext);
+		}
 	};
 
-	// Return the device struct in program memory for given signature.
+	// Return the device struct in program memory for given signature
+	// (binary search of the table sorted by signature).
 	// Return nullptr if device not found.
 	const device_pgm_t* device_for_signature(uint32_t);
+
+	// named fuse settings for a device - must reside in program memory
+	// (lock bits are not part of a preset and are left unchanged)
+	struct fuse_preset_pgm_t
+	{
+		const char*    preset_name;
+		const uint32_t signature;
+		const uint8_t  low;
+		const uint8_t  high;
+		const uint8_t  ext;
+
+		uint32_t get_signature() const
+		{
+			return pgm_read_dword(&signature);
+		}
+
+		uint8_t get_low() const
+		{
+			return pgm_read_byte(&low);
+		}
+
+		uint8_t get_high() const
+		{
+			return pgm_read_byte(&high);
+		}
+
+		uint8_t get_ext() const
+		{
+			return pgm_read_byte(&ext);
+		}
+	};
+
+	// Return the index'th fuse preset in program memory for given
+	// signature, nullptr if there are no more.
+	const fuse_preset_pgm_t* fuse_preset_for_signature(uint32_t,
+							   uint8_t index);
 }
 
 #endif
@@ -0,0 +1,128 @@
+#include"gang_programmer.hpp"
+
+#include<Arduino.h>
+#include<HardwareSerial.h>
+
+#include"spi_programmer.hpp"
+
+namespace
+{
+	constexpr uint32_t max_clock_rate = 8000000;
+	constexpr uint32_t min_clock_rate = 125000; // SPI can't go lower
+
+	// true while a successful program enable has begun SPI, each
+	// begin is counted by the SPI library so it is ended before the
+	// next socket is enabled and only one is left for the caller
+	bool spi_begun = false;
+
+	bool program_enable(const uint32_t clock_rate, const bool verbose)
+	{
+		if (spi_begun)
+			spi_programmer::program_disable();
+		spi_begun = spi_programmer::program_enable(
+			SPISettings(clock_rate, MSBFIRST, SPI_MODE0),
+			0, // retries
+			verbose);
+		return spi_begun;
+	}
+}
+
+void gang_programmer::begin()
+{
+	for (uint8_t pin : socket_pins)
+	{
+		digitalWrite(pin, HIGH);
+		pinMode(pin, OUTPUT);
+	}
+}
+
+void gang_programmer::select(const uint8_t socket)
+{
+	deselect();
+	digitalWrite(socket_pins[socket], LOW);
+	// each target has its own extended address byte loaded
+	spi_programmer::invalidate_extended_address();
+}
+
+void gang_programmer::deselect()
+{
+	for (uint8_t pin : socket_pins)
+		digitalWrite(pin, HIGH);
+}
+
+uint8_t gang_programmer::enable_programming(uint8_t sockets,
+					    uint32_t& clock_rate,
+					    bool verbose)
+{
+	clock_rate = max_clock_rate;
+	spi_begun = false;
+	for (uint8_t socket = 0; socket < max_sockets; ++socket)
+	{
+		if (!(sockets & 1 << socket))
+			continue;
+
+		select(socket);
+		uint32_t socket_clock_rate = clock_rate;
+		while (!program_enable(socket_clock_rate, verbose))
+		{
+			socket_clock_rate /= 2;
+			if (socket_clock_rate < min_clock_rate)
+				break;
+			delay(50);
+		}
+
+		if (socket_clock_rate < min_clock_rate)
+		{
+			Serial.print(F("Unable to enable programming "
+				       "of socket "));
+			Serial.println(socket + 1);
+			sockets &= ~(1 << socket);
+		}
+		else
+		{
+			clock_rate = socket_clock_rate;
+		}
+	}
+
+	// enable all at common clock rate, a failure resets all of them
+	bool all_enabled = false;
+	while (sockets && !all_enabled)
+	{
+		all_enabled = true;
+		for (uint8_t socket = 0; socket < max_sockets; ++socket)
+		{
+			if (!(sockets & 1 << socket))
+				continue;
+
+			select(socket);
+			if (!program_enable(clock_rate, verbose))
+			{
+				sockets &= ~(1 << socket);
+				all_enabled = false;
+				break;
+			}
+		}
+	}
+
+	deselect();
+
+	if (verbose)
+	{
+		Serial.print(F("Programming enabled at clock rate "));
+		Serial.println(clock_rate);
+	}
+
+	return sockets;
+}
+
+void gang_programmer::output_sockets(const uint8_t sockets)
+{
+	for (uint8_t socket = 0; socket < max_sockets; ++socket)
+	{
+		if (sockets & 1 << socket)
+		{
+			Serial.print(socket + 1);
+			Serial.print(' ');
+		}
+	}
+}
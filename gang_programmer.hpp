@@ -0,0 +1,46 @@
+#ifndef GANG_PROGRAMMER_HPP
+#define GANG_PROGRAMMER_HPP
+
+#include<stdint.h>
+
+namespace gang_programmer
+{
+	// Gang programming addresses several identical targets which all
+	// share RESET on SS (pin 10).  Each socket's MOSI, MISO and SCK
+	// pass through a tri-state buffer (like a 74HC125) enabled by
+	// driving that socket's select pin LOW, so only the selected
+	// socket sees the SPI bus while all of them stay in programming
+	// mode.  See README for wiring.
+
+	constexpr uint8_t max_sockets = 4;
+
+	// select pins of sockets, change these to suit the fixture
+	constexpr uint8_t socket_pins[max_sockets] = {2, 3, 4, 5};
+
+	static_assert(max_sockets <= 8, "sockets are tracked as bits");
+
+	constexpr uint8_t all_sockets = (1 << max_sockets) - 1;
+
+	// make select pins outputs with all sockets deselected
+	void begin();
+
+	// select single socket (0 based), deselecting all others
+	void select(const uint8_t socket);
+	void deselect();
+
+	// Enable programming of sockets in mask, each socket's highest
+	// working clock is found and all are then enabled at the lowest
+	// of those.  Return mask of sockets with programming enabled and
+	// the clock rate used.  Targets share RESET so every failed
+	// attempt resets all sockets, hence the final pass repeats until
+	// all remaining sockets are enabled together.  When any socket is
+	// enabled SPI is left begun once, end it with a single
+	// spi_programmer::program_disable().
+	uint8_t enable_programming(uint8_t sockets, uint32_t& clock_rate,
+				   bool verbose = false);
+
+	// output socket numbers (1 based) of mask on Serial
+	void output_sockets(const uint8_t sockets);
+}
+
+#endif
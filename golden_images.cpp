@@ -0,0 +1,32 @@
+#include"golden_images.hpp"
+
+#if __has_include("golden_image_data.inc")
+#include"golden_image_data.inc"
+#endif
+
+namespace
+{
+#ifdef GOLDEN_IMAGE_ENTRIES
+	const PROGMEM golden_images::image_pgm_t images[] = {
+		GOLDEN_IMAGE_ENTRIES
+	};
+
+	constexpr uint8_t image_count = sizeof(images) / sizeof(images[0]);
+
+	static_assert(sizeof(images) / sizeof(images[0]) <= 10,
+		      "too many golden images, must be at most 10");
+#else
+	const golden_images::image_pgm_t* const images = nullptr;
+	constexpr uint8_t image_count = 0;
+#endif
+}
+
+uint8_t golden_images::count()
+{
+	return image_count;
+}
+
+const golden_images::image_pgm_t* golden_images::image(uint8_t index)
+{
+	return &images[index];
+}
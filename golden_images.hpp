@@ -0,0 +1,81 @@
+#ifndef GOLDEN_IMAGES_HPP
+#define GOLDEN_IMAGES_HPP
+
+#include<stddef.h>
+#include<stdint.h>
+#include<avr/pgmspace.h>
+
+namespace golden_images
+{
+	// Images embedded in program memory at build time.  Generate
+	// golden_image_data.inc with "make golden GOLDEN=..." (see README),
+	// without it no images are built in.
+
+	// image details - must reside in program memory
+	struct image_pgm_t
+	{
+		const char*    image_name;
+		const uint32_t expected_signature;
+		const uint8_t  lock;
+		const uint8_t  low;
+		const uint8_t  high;
+		const uint8_t  ext;
+		const bool     has_fuses;
+		const uint8_t* data;   // flash image from address 0
+		const uint32_t size;   // bytes in data
+		// optional patch (see patches.hpp), patch_length 0 if none
+		const uint32_t patch_address;
+		const uint8_t  patch_length;
+		const uint32_t patch_increment;
+		const uint32_t patch_initial;
+
+		uint32_t get_expected_signature() const
+		{
+			return pgm_read_dword(&expected_signature);
+		}
+
+		bool get_has_fuses() const
+		{
+			return pgm_read_byte(&has_fuses);
+		}
+
+		const uint8_t* get_data() const
+		{
+			return reinterpret_cast<const uint8_t*>(
+				pgm_read_ptr(&data));
+		}
+
+		uint32_t get_size() const
+		{
+			return pgm_read_dword(&size);
+		}
+
+		uint32_t get_patch_address() const
+		{
+			return pgm_read_dword(&patch_address);
+		}
+
+		uint8_t get_patch_length() const
+		{
+			return pgm_read_byte(&patch_length);
+		}
+
+		uint32_t get_patch_increment() const
+		{
+			return pgm_read_dword(&patch_increment);
+		}
+
+		uint32_t get_patch_initial() const
+		{
+			return pgm_read_dword(&patch_initial);
+		}
+	};
+
+	// number of images built in
+	uint8_t count();
+
+	// Return the image in program memory at index (< count())
+	const image_pgm_t* image(uint8_t index);
+}
+
+#endif
@@ -0,0 +1,215 @@
+// Convert one or more I8HEX images (as produced by the backup menu
+// option, or plain I8HEX files) into golden_image_data.inc which is
+// built into the programmer's program memory by golden_images.cpp
+//
+// usage: hex2golden <name> <file> [<name> <file> ...]
+//
+// Each image must start with a ";sig" directive, ";fuses" and a single
+// ";patch" are optional and an ";eeprom" section is ignored.
+
+#include"I8HEX_decoder.hpp"
+
+#include<cstdio>
+#include<cstdlib>
+#include<fstream>
+#include<iostream>
+#include<string>
+#include<vector>
+
+namespace
+{
+	constexpr size_t page_size = 256;
+	constexpr size_t bytes_per_line = 16;
+
+	struct golden_image
+	{
+		std::string name;
+		uint32_t signature = 0;
+		bool has_fuses = false;
+		unsigned fuses[4] = {0xff, 0xff, 0xff, 0xff};
+		unsigned patch[4] = {0, 0, 0, 0}; // address length inc initial
+		std::vector<uint8_t> data;
+	};
+
+	// decoder sink merging each page into an image's data
+	struct image_sink
+	{
+		explicit image_sink(golden_image& image)
+			: image(image)
+		{
+		}
+
+		golden_image& image;
+
+		const char* operator()(const paged::Decoder& decoder)
+		{
+			const uint32_t address =
+				decoder.get_buffer_address_on_target();
+			std::vector<uint8_t>& data = image.data;
+			for (size_t ix = 0; ix < decoder.page_size; ++ix)
+			{
+				if (decoder.buffer[ix] == 0xff)
+					continue;
+				if (data.size() <= address + ix)
+					data.resize(address + ix + 1, 0xff);
+				data[address + ix] = decoder.buffer[ix];
+			}
+			return nullptr;
+		}
+	};
+
+	bool starts_with(const std::string& line, const char* prefix)
+	{
+		return line.compare(0, std::string(prefix).size(), prefix) == 0;
+	}
+
+	bool read_image(const char* filename, golden_image& image)
+	{
+		std::ifstream in(filename);
+		if (!in)
+		{
+			std::cerr << filename << ": cannot open\n";
+			return false;
+		}
+
+		uint8_t buffer[page_size];
+		image_sink sink(image);
+		I8HEX::Decoder decoder(buffer, page_size, sink);
+
+		bool have_sig = false;
+		bool in_eeprom = false;
+		std::string line;
+		for (unsigned line_no = 1; std::getline(in, line); ++line_no)
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (in_eeprom)
+			{
+				// skip up to and including its end of file record
+				if (line.size() >= 9 && line[0] == ':'
+				    && line.compare(7, 2, "01") == 0)
+					in_eeprom = false;
+				continue;
+			}
+
+			if (starts_with(line, ";sig"))
+			{
+				have_sig = std::sscanf(line.c_str() + 4, "%x",
+						       &image.signature) == 1;
+			}
+			else if (starts_with(line, ";fuses"))
+			{
+				image.has_fuses = std::sscanf(
+					line.c_str() + 6, "%x %x %x %x",
+					&image.fuses[0], &image.fuses[1],
+					&image.fuses[2], &image.fuses[3]) == 4;
+			}
+			else if (starts_with(line, ";patch"))
+			{
+				if (std::sscanf(line.c_str() + 6, "%x %x %x %x",
+						&image.patch[0], &image.patch[1],
+						&image.patch[2],
+						&image.patch[3]) < 3 ||
+				    image.patch[1] < 1 || image.patch[1] > 4)
+				{
+					std::cerr << filename << ':' << line_no
+						  << ": invalid ;patch\n";
+					return false;
+				}
+			}
+			else if (starts_with(line, ";eeprom"))
+			{
+				in_eeprom = true;
+			}
+			else if (starts_with(line, ";end"))
+			{
+				break;
+			}
+			else if (starts_with(line, ":"))
+			{
+				line += '\n';
+				decoder.decode(line.c_str(), line.size());
+				if (decoder.error())
+				{
+					std::cerr << filename << ':' << line_no
+						  << ": " << decoder.error()
+						  << '\n';
+					return false;
+				}
+			}
+		}
+
+		if (!have_sig)
+		{
+			std::cerr << filename << ": missing ;sig directive\n";
+			return false;
+		}
+		if (!decoder.done())
+		{
+			std::cerr << filename << ": missing end of file record\n";
+			return false;
+		}
+
+		// trailing erased bytes need not be stored
+		while (!image.data.empty() && image.data.back() == 0xff)
+			image.data.pop_back();
+		// patched bytes must be within the image to be written
+		if (image.data.size() < image.patch[0] + image.patch[1])
+			image.data.resize(image.patch[0] + image.patch[1], 0xff);
+		return true;
+	}
+
+	void write_image(const golden_image& image, size_t index)
+	{
+		std::printf("const PROGMEM char golden_name_%zu[] = \"%s\";\n",
+			    index, image.name.c_str());
+		std::printf("const PROGMEM uint8_t golden_data_%zu[] = {", index);
+		for (size_t ix = 0; ix < image.data.size(); ++ix)
+			std::printf("%s0x%02x,",
+				    ix % bytes_per_line ? " " : "\n\t",
+				    image.data[ix]);
+		std::printf("\n};\n\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3 || argc % 2 == 0)
+	{
+		std::cerr << "usage: " << argv[0]
+			  << " <name> <file> [<name> <file> ...]\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<golden_image> images;
+	for (int arg = 1; arg < argc; arg += 2)
+	{
+		images.emplace_back();
+		images.back().name = argv[arg];
+		if (!read_image(argv[arg + 1], images.back()))
+			return EXIT_FAILURE;
+	}
+
+	std::printf("// generated by host_tools/hex2golden, do not edit\n\n");
+	for (size_t ix = 0; ix < images.size(); ++ix)
+		write_image(images[ix], ix);
+
+	std::printf("#define GOLDEN_IMAGE_ENTRIES \\\n");
+	for (size_t ix = 0; ix < images.size(); ++ix)
+	{
+		const golden_image& image = images[ix];
+		std::printf("\t{golden_name_%zu, 0x%06X, 0x%02X, 0x%02X, "
+			    "0x%02X, 0x%02X, %s, golden_data_%zu, "
+			    "sizeof(golden_data_%zu), "
+			    "0x%X, %u, 0x%X, 0x%X}, \\\n",
+			    ix, image.signature,
+			    image.fuses[0], image.fuses[1],
+			    image.fuses[2], image.fuses[3],
+			    image.has_fuses ? "true" : "false", ix, ix,
+			    image.patch[0], image.patch[1],
+			    image.patch[2], image.patch[3]);
+	}
+	std::printf("\n");
+	return EXIT_SUCCESS;
+}
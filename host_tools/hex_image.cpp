@@ -0,0 +1,323 @@
+#include"hex_image.hpp"
+#include"I8HEX_decoder.hpp"
+
+#include<algorithm>
+#include<atomic>
+#include<cerrno>
+#include<cstring>
+#include<thread>
+#include<vector>
+
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+
+namespace
+{
+	using hex_image::page_size;
+
+	// chunks are at least this long so they are worth a thread
+	constexpr size_t min_chunk_size = 64 * 1024;
+
+	struct chunk
+	{
+		const char* begin;
+		const char* end;
+		// found by scan(): last extended address record (0x02 or
+		// 0x04) and first end of file record, nullptr if none
+		const char* address_record = nullptr;
+		const char* end_of_file = nullptr;
+		// last extended address record of the chunks before it,
+		// decoded first so addresses continue from them
+		const char* base_record = nullptr;
+		hex_image::image result;
+		const char* error_at = nullptr;
+	};
+
+	void note_overlap(hex_image::image& image, const uint32_t address)
+	{
+		if (!image.overlaps || address < image.first_overlap)
+			image.first_overlap = address;
+		++image.overlaps;
+	}
+
+	// streaming decoder sink storing each byte into a chunk's image
+	struct chunk_sink
+	{
+		explicit chunk_sink(hex_image::image& image)
+			: image(image)
+		{
+		}
+
+		hex_image::image& image;
+		uint32_t page_address = 0;
+		hex_image::page* page = nullptr; // last decoded into
+
+		// page end, there is nothing to do
+		const char* operator()(const paged::Decoder&)
+		{
+			return nullptr;
+		}
+
+		const char* operator()(const paged::Decoder&,
+				       const uint32_t address,
+				       const uint8_t value)
+		{
+			const uint32_t address_of_page =
+				address & ~static_cast<uint32_t>(page_size - 1);
+			if (!page || address_of_page != page_address)
+			{
+				page = &image.pages[address_of_page];
+				page_address = address_of_page;
+			}
+			const size_t offset = address & (page_size - 1);
+			if (page->decoded[offset])
+				note_overlap(image, address);
+			page->decoded[offset] = true;
+			page->data[offset] = value;
+			return nullptr;
+		}
+	};
+
+	// call function(ix) for ix 0 to count - 1 on up to threads threads
+	template <typename Function>
+	void for_each_parallel(const size_t count,
+			       const unsigned threads,
+			       Function function)
+	{
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			for (size_t ix; (ix = next++) < count;)
+				function(ix);
+		};
+		std::vector<std::thread> pool;
+		for (unsigned thread = 1; thread < threads && thread < count;
+		     ++thread)
+			pool.emplace_back(worker);
+		worker();
+		for (std::thread& thread : pool)
+			thread.join();
+	}
+
+	// split data into chunks which end after a newline, a few per
+	// thread to even out their load
+	std::vector<chunk> split(const char* const data,
+				 const size_t length,
+				 const unsigned threads)
+	{
+		const size_t chunk_size = std::max(min_chunk_size,
+						   length / (threads * 4) + 1);
+		const char* const end = data + length;
+		std::vector<chunk> chunks;
+		for (const char* begin = data; begin < end;)
+		{
+			const char* chunk_end = begin +
+				std::min(chunk_size, size_t(end - begin));
+			const void* nl = std::memchr(chunk_end - 1, '\n',
+						     end - chunk_end + 1);
+			chunk_end = nl ? static_cast<const char*>(nl) + 1 : end;
+			chunks.emplace_back();
+			chunks.back().begin = begin;
+			chunks.back().end = chunk_end;
+			begin = chunk_end;
+		}
+		return chunks;
+	}
+
+	// find the records of c which affect other chunks, malformed
+	// lines are left for the decoder to report
+	void scan(chunk& c)
+	{
+		for (const char* line = c.begin; line < c.end;)
+		{
+			const void* nl = std::memchr(line, '\n', c.end - line);
+			const char* next = nl ?
+				static_cast<const char*>(nl) + 1 : c.end;
+			if (next - line >= 9 && line[0] == ':' &&
+			    line[7] == '0')
+			{
+				if (line[8] == '2' || line[8] == '4')
+					c.address_record = line;
+				else if (line[8] == '1' && !c.end_of_file)
+					c.end_of_file = line;
+			}
+			line = next;
+		}
+	}
+
+	void decode_chunk(chunk& c)
+	{
+		chunk_sink sink(c.result);
+		I8HEX::Decoder decoder(page_size, sink);
+		if (c.base_record)
+		{
+			// chunks before the last one end with a newline
+			const char* nl = c.base_record;
+			while (*nl != '\n')
+				++nl;
+			decoder.decode(c.base_record, nl + 1 - c.base_record);
+		}
+		const size_t consumed = decoder.decode(c.begin,
+						       c.end - c.begin);
+		// last line of the file may lack its newline
+		if (!decoder.done() && !decoder.error() && c.end[-1] != '\n')
+			decoder.decode('\n');
+
+		if (decoder.error())
+		{
+			c.result.error = decoder.error();
+			c.error_at = c.begin + consumed;
+		}
+		else if (!decoder.done())
+		{
+			decoder.finish();
+		}
+	}
+
+	// merge from into image, from is decoded after image
+	void merge(hex_image::image& image, hex_image::image& from)
+	{
+		if (from.overlaps)
+		{
+			if (!image.overlaps ||
+			    from.first_overlap < image.first_overlap)
+				image.first_overlap = from.first_overlap;
+			image.overlaps += from.overlaps;
+		}
+
+		for (auto& from_page : from.pages)
+		{
+			auto it = image.pages.find(from_page.first);
+			if (it == image.pages.end())
+			{
+				image.pages.emplace_hint(
+					it, from_page.first,
+					std::move(from_page.second));
+				continue;
+			}
+			hex_image::page& to = it->second;
+			const hex_image::page& page = from_page.second;
+			for (size_t ix = 0; ix < page_size; ++ix)
+			{
+				if (!page.decoded[ix])
+					continue;
+				if (to.decoded[ix])
+					note_overlap(image,
+						     from_page.first + ix);
+				to.decoded[ix] = true;
+				to.data[ix] = page.data[ix];
+			}
+		}
+	}
+}
+
+uint32_t hex_image::image::begin() const
+{
+	if (pages.empty())
+		return 0;
+	const auto& first = *pages.begin();
+	size_t ix = 0;
+	while (!first.second.decoded[ix])
+		++ix;
+	return first.first + ix;
+}
+
+uint32_t hex_image::image::end() const
+{
+	if (pages.empty())
+		return 0;
+	const auto& last = *pages.rbegin();
+	size_t ix = page_size;
+	while (!last.second.decoded[ix - 1])
+		--ix;
+	return last.first + ix;
+}
+
+hex_image::image hex_image::decode(const char* const data,
+				   const size_t length,
+				   unsigned threads)
+{
+	if (!threads)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<chunk> chunks = split(data, length, threads);
+	for_each_parallel(chunks.size(), threads, [&](const size_t ix) {
+		scan(chunks[ix]);
+	});
+
+	// decoding stops at the first end of file record, like the
+	// I8HEX::Decoder would, so later chunks are dropped
+	image result;
+	const char* address_record = nullptr;
+	size_t used = 0;
+	while (used < chunks.size() && !chunks[used].end_of_file)
+	{
+		chunks[used].base_record = address_record;
+		if (chunks[used].address_record)
+			address_record = chunks[used].address_record;
+		++used;
+	}
+	if (used == chunks.size())
+	{
+		result.error = "missing end of file record";
+		return result;
+	}
+	chunks[used++].base_record = address_record;
+	chunks.resize(used);
+
+	for_each_parallel(chunks.size(), threads, [&](const size_t ix) {
+		decode_chunk(chunks[ix]);
+	});
+
+	for (chunk& c : chunks)
+	{
+		if (!c.result.error.empty())
+		{
+			const size_t line = 1 + std::count(data, c.error_at,
+							   '\n');
+			result.error = "line " + std::to_string(line) + ": " +
+				c.result.error;
+			return result;
+		}
+		merge(result, c.result);
+	}
+	for (const auto& page : result.pages)
+		result.bytes += page.second.decoded.count();
+	return result;
+}
+
+hex_image::image hex_image::decode_file(const char* const filename,
+					const unsigned threads)
+{
+	image result;
+	const int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) < 0)
+	{
+		result.error = std::strerror(errno);
+		if (fd >= 0)
+			close(fd);
+		return result;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		result.error = "missing end of file record";
+		return result;
+	}
+
+	void* const data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE,
+				fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		result.error = std::strerror(errno);
+		return result;
+	}
+	madvise(data, st.st_size, MADV_WILLNEED);
+	result = decode(static_cast<const char*>(data), st.st_size,
+			threads);
+	munmap(data, st.st_size);
+	return result;
+}
@@ -0,0 +1,53 @@
+#ifndef HEX_IMAGE_HPP
+#define HEX_IMAGE_HPP
+
+// Decode a whole I8HEX file on the host into a sparse page image, the
+// file is memory mapped and split on record boundaries into chunks
+// which are decoded in parallel, each by its own I8HEX::Decoder, and
+// merged in file order.
+
+#include<array>
+#include<bitset>
+#include<cstddef>
+#include<cstdint>
+#include<map>
+#include<string>
+
+namespace hex_image
+{
+	constexpr size_t page_size = 256;
+
+	struct page
+	{
+		std::array<uint8_t, page_size> data;
+		std::bitset<page_size> decoded; // bytes of data set by records
+
+		page()
+		{
+			data.fill(0xff);
+		}
+	};
+
+	struct image
+	{
+		std::map<uint32_t, page> pages; // by page aligned address
+		size_t bytes = 0;            // decoded bytes, overlaps once
+		size_t overlaps = 0;         // bytes decoded more than once,
+		uint32_t first_overlap = 0;  // the later record wins
+		std::string error;           // empty if decoded
+
+		// return lowest and one past highest decoded address, both 0
+		// if nothing was decoded
+		uint32_t begin() const;
+		uint32_t end() const;
+	};
+
+	// decode length chars of I8HEX at data using up to threads
+	// threads (0 for one per core), directive lines are not allowed
+	image decode(const char* data, size_t length, unsigned threads = 0);
+
+	// memory map filename and decode it as above
+	image decode_file(const char* filename, unsigned threads = 0);
+}
+
+#endif
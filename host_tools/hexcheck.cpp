@@ -0,0 +1,122 @@
+// Check I8HEX files decode without errors or overlapping records and
+// optionally convert them to the raw binary images the loader's ;bin
+// directive takes (see BIN::Decoder), written to <file>.bin
+//
+// usage: hexcheck [-j <threads>] [-b] <file> [<file> ...]
+//
+// Files are decoded by hex_image::decode_file() on all cores unless
+// -j limits the threads, a summary line is printed for each file.
+
+#include"BIN_decoder.hpp"
+#include"hex_image.hpp"
+
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<iostream>
+#include<string>
+#include<vector>
+
+namespace
+{
+	// append value as bytes least significant first
+	void put_le(std::vector<uint8_t>& out, uint32_t value,
+		    const size_t bytes)
+	{
+		for (size_t ix = 0; ix < bytes; ++ix, value >>= 8)
+			out.push_back(value & 0xff);
+	}
+
+	// write image from its lowest to highest address, gaps 0xff
+	bool write_bin(const std::string& filename,
+		       const hex_image::image& image)
+	{
+		const uint32_t begin = image.begin();
+		const uint32_t length = image.end() - begin;
+		std::vector<uint8_t> bin;
+		put_le(bin, begin, 4);
+		put_le(bin, length, 4);
+		bin.resize(bin.size() + length, 0xff);
+		for (const auto& page : image.pages)
+			for (size_t ix = 0; ix < hex_image::page_size; ++ix)
+				if (page.second.decoded[ix])
+					bin[8 + page.first + ix - begin] =
+						page.second.data[ix];
+		uint16_t crc = 0;
+		for (uint8_t byte : bin)
+			crc = BIN::Decoder::crc16(crc, byte);
+		put_le(bin, crc, 2);
+
+		std::FILE* out = std::fopen(filename.c_str(), "wb");
+		if (!out)
+		{
+			std::cerr << filename << ": cannot create\n";
+			return false;
+		}
+		const bool written =
+			std::fwrite(bin.data(), 1, bin.size(), out) ==
+			bin.size();
+		return std::fclose(out) == 0 && written;
+	}
+
+	bool check_file(const char* filename, const unsigned threads,
+			const bool convert)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const hex_image::image image =
+			hex_image::decode_file(filename, threads);
+		const std::chrono::duration<double, std::milli> elapsed =
+			std::chrono::steady_clock::now() - start;
+
+		if (!image.error.empty())
+		{
+			std::cerr << filename << ": " << image.error << '\n';
+			return false;
+		}
+		std::printf("%s: %zu bytes, 0x%X to 0x%X, %zu pages, "
+			    "%.2f ms\n", filename, image.bytes, image.begin(),
+			    image.end(), image.pages.size(), elapsed.count());
+		if (image.overlaps)
+		{
+			std::fprintf(stderr, "%s: %zu bytes decoded more than "
+				     "once, first at 0x%X\n", filename,
+				     image.overlaps, image.first_overlap);
+			return false;
+		}
+		if (convert && !write_bin(std::string(filename) + ".bin",
+					  image))
+		{
+			std::cerr << filename << ".bin: write failed\n";
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned threads = 0;
+	bool convert = false;
+	int arg = 1;
+	for (; arg < argc && argv[arg][0] == '-'; ++arg)
+	{
+		if (std::strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+			threads = std::strtoul(argv[++arg], nullptr, 10);
+		else if (std::strcmp(argv[arg], "-b") == 0)
+			convert = true;
+		else
+			break;
+	}
+	if (arg == argc || argv[arg][0] == '-')
+	{
+		std::cerr << "usage: " << argv[0]
+			  << " [-j <threads>] [-b] <file> [<file> ...]\n";
+		return EXIT_FAILURE;
+	}
+
+	bool success = true;
+	for (; arg < argc; ++arg)
+		success = check_file(argv[arg], threads, convert) && success;
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
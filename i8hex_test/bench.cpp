@@ -0,0 +1,203 @@
+#include<algorithm>
+#include<chrono>
+#include<cstddef>
+#include<cstdint>
+#include<cstdlib>
+#include<iomanip>
+#include<iostream>
+#include<random>
+#include<sstream>
+#include<string>
+#include<utility>
+#include<vector>
+
+#include"I8HEX_decoder.hpp"
+#include"I8HEX_encoder.hpp"
+
+// Decoder throughput over synthetic images, one line per case of
+// whitespace separated columns (see the header line) so results can be
+// compared between builds.
+
+namespace
+{
+	// collects encoder output
+	struct String_sink
+	{
+		std::string str;
+
+		void operator()(const char* s, const std::size_t length)
+		{
+			str.append(s, length);
+		}
+	};
+
+	// decoder sink counting the pages handed over
+	struct Counting_sink
+	{
+		unsigned flushes = 0;
+		std::uint32_t checksum = 0; // so the work is not elided
+
+		const char* operator()(const paged::Decoder& decoder)
+		{
+			++flushes;
+			checksum += decoder.buffer[decoder.get_dirty_begin()];
+			return nullptr;
+		}
+	};
+
+	// return I8HEX image of image_bytes of data at address 0 with
+	// records of record_length bytes, shuffled if asked
+	std::string make_image(const std::size_t image_bytes,
+			       const std::uint8_t record_length,
+			       const bool shuffled)
+	{
+		std::vector<std::uint8_t> data(image_bytes);
+		std::mt19937 random(image_bytes + record_length);
+		for (std::uint8_t& byte : data)
+			byte = random(); // no 0xff runs worth eliding
+
+		String_sink sink;
+		I8HEX::Encoder encoder(record_length, sink);
+		encoder.encode(0, data.data(), data.size());
+
+		// data records with their 64K segment, an extended linear
+		// address record is added again wherever the segment
+		// changes after shuffling
+		std::vector<std::pair<std::uint16_t, std::string>> records;
+		std::uint16_t segment = 0;
+		for (std::size_t pos = 0; pos < sink.str.size();)
+		{
+			const std::size_t end = sink.str.find('\n', pos) + 1;
+			const std::string line = sink.str.substr(pos,
+								 end - pos);
+			if (line.compare(7, 2, "04") == 0)
+				segment = std::stoul(line.substr(9, 4),
+						     nullptr, 16);
+			else
+				records.push_back({segment, line});
+			pos = end;
+		}
+		if (shuffled)
+			std::shuffle(records.begin(), records.end(), random);
+
+		std::string image;
+		segment = 0;
+		for (const auto& record : records)
+		{
+			if (record.first != segment)
+			{
+				segment = record.first;
+				const std::uint8_t upper[] = {
+					static_cast<std::uint8_t>(segment >> 8),
+					static_cast<std::uint8_t>(segment)};
+				const std::uint8_t sum = 2 + 4 + upper[0] +
+					upper[1];
+				std::ostringstream oss;
+				oss << ":02000004" << std::hex
+				    << std::uppercase << std::setfill('0')
+				    << std::setw(4) << segment
+				    << std::setw(2)
+				    << static_cast<unsigned>(
+					    static_cast<std::uint8_t>(-sum))
+				    << "\r\n";
+				image += oss.str();
+			}
+			image += record.second;
+		}
+		image += ":00000001FF\r\n";
+		return image;
+	}
+
+	struct result
+	{
+		double mb_per_s;
+		double ns_per_char;
+		unsigned flushes;
+	};
+
+	// decode image repeatedly for at least min_time, return rate of
+	// the fastest run and flushes of one run
+	result time_decode(const std::string& image,
+			   const std::size_t page_size,
+			   const std::uint8_t cache_pages)
+	{
+		static const std::chrono::milliseconds min_time(50);
+		std::vector<std::uint8_t> buffer(page_size * cache_pages);
+		std::chrono::steady_clock::duration fastest =
+			std::chrono::steady_clock::duration::max();
+		std::chrono::steady_clock::duration total{};
+		unsigned flushes = 0;
+
+		for (unsigned run = 0; run < 3 || total < min_time; ++run)
+		{
+			Counting_sink sink;
+			I8HEX::Decoder decoder(buffer.data(), page_size, sink,
+					       cache_pages);
+			const auto start = std::chrono::steady_clock::now();
+			decoder.decode(image.data(), image.size());
+			const auto elapsed =
+				std::chrono::steady_clock::now() - start;
+			if (decoder.error() || !decoder.done())
+			{
+				std::cerr << "decode failed: "
+					  << (decoder.error() ?
+					      decoder.error() : "not done")
+					  << std::endl;
+				std::exit(1);
+			}
+			fastest = std::min(fastest, elapsed);
+			total += elapsed;
+			flushes = sink.flushes;
+		}
+
+		const double ns = std::chrono::duration<double, std::nano>(
+			fastest).count();
+		return result{image.size() * 1e3 / ns, ns / image.size(),
+			      flushes};
+	}
+
+	// time decoding of one image into each page size and cache
+	void bench_image(const std::size_t image_bytes,
+			 const std::uint8_t record_length,
+			 const bool shuffled)
+	{
+		const std::string image = make_image(image_bytes,
+						     record_length, shuffled);
+		const std::uint8_t max_cache_pages =
+			I8HEX::Decoder::max_cache_pages;
+
+		for (std::size_t page_size : {32, 64, 128, 256})
+		{
+			for (std::uint8_t cache_pages : {std::uint8_t(1),
+							 max_cache_pages})
+			{
+				const result r = time_decode(image, page_size,
+							     cache_pages);
+				std::cout << image_bytes << ' '
+					  << unsigned(record_length) << ' '
+					  << page_size << ' '
+					  << unsigned(cache_pages) << ' '
+					  << (shuffled ? "shuffled" : "ordered")
+					  << ' ' << image.size() << ' '
+					  << std::fixed << std::setprecision(2)
+					  << r.mb_per_s << ' '
+					  << r.ns_per_char << ' '
+					  << r.flushes << std::endl;
+			}
+		}
+	}
+}
+
+int main()
+{
+	std::cout << "# image_bytes record_length page_size cache_pages "
+		"order chars mb_per_s ns_per_char flushes" << std::endl;
+
+	for (std::size_t image_bytes : {8192, 65536, 262144})
+		for (std::uint8_t record_length : {16, 32, 255})
+			for (bool shuffled : {false, true})
+				bench_image(image_bytes, record_length,
+					    shuffled);
+
+	return 0;
+}
@@ -1,15 +1,20 @@
+#include<algorithm>
 #include<array>
-#include<cassert>
 #include<cstddef>
 #include<cstring>
 #include<deque>
 #include<iomanip>
 #include<iostream>
+#include<map>
 #include<sstream>
 #include<string>
 #include<utility>
+#include<vector>
 
 #include"I8HEX_decoder.hpp"
+#include"I8HEX_encoder.hpp"
+#include"SREC_decoder.hpp"
+#include"BIN_decoder.hpp"
 
 template <std::size_t page_size>
 class TestBase
@@ -17,24 +22,16 @@ class TestBase
 protected:
 
 	typedef std::array<std::uint8_t, page_size> raw_buffer;
-	typedef std::pair<std::uint16_t, raw_buffer> addr_raw_buffer;
-
-	TestBase()
-	{
-		assert(current_test_base == nullptr);
-		current_test_base = this;
-	}
-
-	~TestBase()
-	{
-		assert(current_test_base);
-		current_test_base = nullptr;
-	}
+	typedef std::pair<std::uint32_t, raw_buffer> addr_raw_buffer;
+	typedef std::pair<std::size_t, std::size_t> dirty_range;
 
 public:
 
 	void run();
 
+	// decoder sink, called with each full buffer
+	const char* operator()(const paged::Decoder&);
+
 private:
 
 	virtual const char* get_i8hex() const
@@ -47,16 +44,38 @@ private:
 		return std::deque<addr_raw_buffer>{};
 	}
 
+	// expected dirty range of each buffer, not verified if empty
+	virtual std::deque<dirty_range> get_dirty_ranges() const
+	{
+		return std::deque<dirty_range>{};
+	}
+
+	// expected decoded mask of each buffer as one char per byte, 'x'
+	// if decoded into else '.', not verified if empty
+	virtual std::deque<std::string> get_decoded_masks() const
+	{
+		return std::deque<std::string>{};
+	}
+
 	virtual const char* expected_error() const
 	{
 		return nullptr;
 	}
 
+	// number of char passed to each decode call, 0 for all of them,
+	// small chunks split records so they are decoded char by char
+	virtual std::size_t chunk_size() const
+	{
+		return 0;
+	}
+
 	virtual const char* name() const = 0;
 
 	void verify_decoder_initial_state() const;
 	void verify_full_raw_buffer();
 	void verify_buffer(const addr_raw_buffer&);
+	void verify_dirty_range(const dirty_range&);
+	void verify_decoded_mask(const std::string&);
 	bool verify_error();
 	void unexpected_buffer();
 	std::string buffers_decoded_str() const;
@@ -64,15 +83,14 @@ private:
 	raw_buffer buffer;
 	I8HEX::Decoder decoder{buffer.data(),
 			buffer.size(),
-			&buffer_full_verify};
+			*this};
 
 	std::deque<addr_raw_buffer> expected_buffers;
+	std::deque<dirty_range> expected_dirty_ranges;
+	std::deque<std::string> expected_decoded_masks;
+	std::array<std::uint8_t, (page_size + 7) / 8> decoded_mask;
 	unsigned successful_buffers = 0;
-
-	// hack to get to current TestBase via buffer full callback
-	static TestBase* current_test_base;
-	static const char* buffer_full_verify(const I8HEX::Decoder&);
-	static const char* fail_unexpected_buffer(const I8HEX::Decoder&);
+	bool buffers_expected = true;
 };
 
 template <std::size_t page_size>
@@ -81,16 +99,20 @@ void TestBase<page_size>::run()
 	std::cout << "Running test " << name() << std::endl;
 
 	expected_buffers = get_raw_buffers();
+	expected_dirty_ranges = get_dirty_ranges();
+	expected_decoded_masks = get_decoded_masks();
+	decoder.set_decoded_mask(decoded_mask.data());
 
 	verify_decoder_initial_state();
 
 	const char* i8hex_ptr = get_i8hex();
 	std::size_t i8hex_len = std::strlen(i8hex_ptr);
+	const std::size_t chunk = chunk_size() ? chunk_size() : i8hex_len;
 
 	while (expected_buffers.size())
 	{
 		std::size_t len = decoder.decode(i8hex_ptr,
-						 i8hex_len);
+						 std::min(i8hex_len, chunk));
 		i8hex_ptr += len;
 		i8hex_len -= len;
 
@@ -98,12 +120,12 @@ void TestBase<page_size>::run()
 			return; // error was as expected
 	}
 
-	decoder.buffer_full_callback = &fail_unexpected_buffer;
+	buffers_expected = false;
 
 	while (i8hex_len && !decoder.done()) // leftovers to consume
 	{
 		std::size_t len = decoder.decode(i8hex_ptr,
-						 i8hex_len);
+						 std::min(i8hex_len, chunk));
 		i8hex_ptr += len;
 		i8hex_len -= len;
 
@@ -141,9 +163,55 @@ void TestBase<page_size>::verify_full_raw_buffer()
 {
 	verify_buffer(expected_buffers.front());
 	expected_buffers.pop_front();
+	if (expected_dirty_ranges.size())
+	{
+		verify_dirty_range(expected_dirty_ranges.front());
+		expected_dirty_ranges.pop_front();
+	}
+	if (expected_decoded_masks.size())
+	{
+		verify_decoded_mask(expected_decoded_masks.front());
+		expected_decoded_masks.pop_front();
+	}
 	++successful_buffers;
 }
 
+template <std::size_t page_size>
+void TestBase<page_size>::verify_decoded_mask(const std::string& mask)
+{
+	std::string decoded;
+	for (std::size_t ix = 0; ix < page_size; ++ix)
+		decoded += decoder.is_decoded(ix) ? 'x' : '.';
+	if (decoded != mask)
+	{
+		std::cout << name() << " : decoded mask "
+			  << decoded
+			  << " does not match expected mask "
+			  << mask
+			  << buffers_decoded_str()
+			  << std::endl;
+		std::exit(1);
+	}
+}
+
+template <std::size_t page_size>
+void TestBase<page_size>::verify_dirty_range(const dirty_range& dr)
+{
+	if (decoder.get_dirty_begin() != dr.first ||
+	    decoder.get_dirty_end() != dr.second)
+	{
+		std::cout << name() << " : dirty range "
+			  << std::dec
+			  << decoder.get_dirty_begin() << " to "
+			  << decoder.get_dirty_end()
+			  << " does not match expected range "
+			  << dr.first << " to " << dr.second
+			  << buffers_decoded_str()
+			  << std::endl;
+		std::exit(1);
+	}
+}
+
 template <std::size_t page_size>
 void TestBase<page_size>::verify_buffer(const addr_raw_buffer& arb)
 {
@@ -248,23 +316,17 @@ std::string TestBase<page_size>::buffers_decoded_str() const
 }
 
 template <std::size_t page_size>
-TestBase<page_size>* TestBase<page_size>::current_test_base;
-
-template <std::size_t page_size>
-const char* TestBase<page_size>::buffer_full_verify(const I8HEX::Decoder&)
+const char* TestBase<page_size>::operator()(const paged::Decoder&)
 {
-	current_test_base->verify_full_raw_buffer();
+	if (!buffers_expected)
+	{
+		unexpected_buffer();
+		std::exit(1);
+	}
+	verify_full_raw_buffer();
 	return nullptr;
 }
 
-template <std::size_t page_size>
-const char* TestBase<page_size>::fail_unexpected_buffer(const I8HEX::Decoder&)
-{
-	current_test_base->unexpected_buffer();
-	std::exit(1);
-	return nullptr; // as if this will happen
-}
-
 
 // derived test cases from TestBase
 
@@ -761,6 +823,724 @@ class Multi_buffer5 : public TestBase<16>
 	};
 };
 
+class Multi_buffer6 : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Multi buffer 16 bytes earlier record in page\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":0100180011D6\n"
+			":0C0012000102030405060708090A0B0C94\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x0010, {0xff, 0xff, 0x01, 0x02,
+				0x03, 0x04, 0x05, 0x06,
+				0x07, 0x08, 0x09, 0x0a,
+				0x0b, 0x0c, 0xff, 0xff}}};
+	};
+
+	virtual std::deque<dirty_range> get_dirty_ranges() const
+	{
+		return {{2, 14}};
+	}
+};
+
+class Dirty_range_multi_buffer : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Dirty range includes explicit 0xff bytes\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":0C000400FFFF0102030405060708090ABB\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x0000, {0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0x01, 0x02,
+				0x03, 0x04, 0x05, 0x06,
+				0x07, 0x08, 0x09, 0x0a}}};
+	};
+
+	virtual std::deque<dirty_range> get_dirty_ranges() const
+	{
+		// explicit 0xff bytes are dirty
+		return {{4, 16}};
+	}
+};
+
+class Dirty_range_next_buffer : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Dirty range restarts in next 16 byte buffer\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":14000400000102030405060708090A0B0C0D0E0F101112132A\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x0000, {0xff, 0xff, 0xff, 0xff,
+				0x00, 0x01, 0x02, 0x03,
+				0x04, 0x05, 0x06, 0x07,
+				0x08, 0x09, 0x0a, 0x0b}},
+			{0x0010, {0x0c, 0x0d, 0x0e, 0x0f,
+				0x10, 0x11, 0x12, 0x13,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}}};
+	};
+
+	virtual std::deque<dirty_range> get_dirty_ranges() const
+	{
+		return {{4, 16}, {0, 8}};
+	}
+};
+
+class No_buffer_end_of_file : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"No buffer only end of file\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":00000001FF\n";
+	}
+};
+
+class Extended_linear_address : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Extended linear address\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":020000040001F9\n"
+			":04001000AABBCCDDDE\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x10010, {0xaa, 0xbb, 0xcc, 0xdd,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}}};
+	};
+};
+
+class Extended_segment_address : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Extended segment address and back to 0\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":020000021000EC\n"
+			":020020000102DB\n"
+			":020000020000FC\n"
+			":0400000500001234B1 start address ignored\n"
+			":020020000304D7\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x10020, {0x01, 0x02, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}},
+			{0x00020, {0x03, 0x04, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}}};
+	};
+};
+
+class Extended_address_length_error : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Extended address record length error\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":0100000400FB\n";
+	}
+
+	virtual const char* expected_error() const
+	{
+		return "Invalid extended address record length";
+	}
+};
+
+class Record_type_error : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Unsupported record type error\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":00000006FA\n";
+	}
+
+	virtual const char* expected_error() const
+	{
+		return "Invalid/unsupported record type, must be 0 to 5";
+	}
+};
+
+class Multi_buffer_not_power_of_two : public TestBase<12>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Multi buffer 12 bytes (not a power of two)\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":0400100001020304E2\n"
+			":0400160005060708CC\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x000c, {0xff, 0xff, 0xff, 0xff,
+				0x01, 0x02, 0x03, 0x04,
+				0xff, 0xff, 0x05, 0x06}},
+			{0x0018, {0x07, 0x08, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}}};
+	};
+};
+
+class Decoded_mask_gap : public TestBase<16>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Decoded mask excludes gap between records\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":02000200FFFFFE\n"
+			":04000800010203FFEF\n"
+			":020012000405E3\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x0000, {0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0x01, 0x02, 0x03, 0xff,
+				0xff, 0xff, 0xff, 0xff}},
+			{0x0010, {0xff, 0xff, 0x04, 0x05,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff,
+				0xff, 0xff, 0xff, 0xff}}};
+	};
+
+	virtual std::deque<std::string> get_decoded_masks() const
+	{
+		// explicit 0xff bytes are decoded, gaps are not
+		return {"..xx....xxxx....", "..xx............"};
+	}
+};
+
+class Decoded_mask_gap_split : public Decoded_mask_gap
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Records split across decode calls\"";
+	}
+
+	virtual std::size_t chunk_size() const
+	{
+		return 5;
+	}
+};
+
+class Record_across_pages : public TestBase<8>
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Whole record split at page boundary\"";
+	}
+
+	virtual const char* get_i8hex() const
+	{
+		return ":0C000400000102030405060708090A0BAE\n"
+			":00000001FF\n";
+	}
+
+	virtual std::deque<addr_raw_buffer> get_raw_buffers() const
+	{
+		return {{0x0000, {0xff, 0xff, 0xff, 0xff,
+				0x00, 0x01, 0x02, 0x03}},
+			{0x0008, {0x04, 0x05, 0x06, 0x07,
+				0x08, 0x09, 0x0a, 0x0b}}};
+	};
+
+	virtual std::deque<std::string> get_decoded_masks() const
+	{
+		return {"....xxxx", "xxxxxxxx"};
+	}
+};
+
+class Record_across_pages_split : public Record_across_pages
+{
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Record split at page boundary char by char\"";
+	}
+
+	virtual std::size_t chunk_size() const
+	{
+		return 3;
+	}
+};
+
+// base of tests which drive their own decoders rather than TestBase's,
+// it is their sink and keeps everything handed to it
+template <std::size_t page_size>
+class SinkTestBase
+{
+public:
+
+	void run()
+	{
+		std::cout << "Running test " << name() << std::endl;
+		test();
+	}
+
+	// decoder sink, called with each flushed page
+	const char* operator()(const paged::Decoder&);
+
+	// decoder sink, called with each streamed byte
+	const char* operator()(const paged::Decoder&,
+			       std::uint32_t address,
+			       std::uint8_t value)
+	{
+		streamed.push_back({address, value});
+		return nullptr;
+	}
+
+protected:
+
+	typedef std::array<std::uint8_t, page_size> page;
+	typedef std::deque<std::pair<std::uint32_t, page>> page_list;
+
+	void fail(const char* what) const
+	{
+		std::cout << name() << " : " << what << std::endl;
+		std::exit(1);
+	}
+
+	void clear()
+	{
+		ranges.clear();
+		pages.clear();
+		decoded.clear();
+		streamed.clear();
+	}
+
+	// page address, dirty begin and end of each page flushed
+	std::deque<std::array<std::size_t, 3>> ranges;
+	// each page flushed from a buffer
+	page_list pages;
+	// bytes decoded into flushed pages (only those in the decoded
+	// mask if there is one)
+	std::map<std::uint32_t, std::uint8_t> decoded;
+	std::deque<std::pair<std::uint32_t, std::uint8_t>> streamed;
+
+private:
+
+	virtual void test() = 0;
+	virtual const char* name() const = 0;
+};
+
+template <std::size_t page_size>
+const char* SinkTestBase<page_size>::operator()(const paged::Decoder& decoder)
+{
+	const std::uint32_t address = decoder.get_buffer_address_on_target();
+	ranges.push_back({{address, decoder.get_dirty_begin(),
+			   decoder.get_dirty_end()}});
+	if (!decoder.buffer)
+		return nullptr; // streamed, bytes are kept as they come
+
+	page p;
+	std::copy(decoder.buffer, decoder.buffer + p.size(), p.begin());
+	pages.push_back({address, p});
+	for (std::size_t ix = decoder.get_dirty_begin();
+	     ix < decoder.get_dirty_end(); ++ix)
+		if (!decoder.get_decoded_mask() || decoder.is_decoded(ix))
+			decoded[address + ix] = decoder.buffer[ix];
+	return nullptr;
+}
+
+// streaming decoder has no buffer, the test is its sink for both pages
+// and bytes
+class Streaming_bytes : public SinkTestBase<8>
+{
+	virtual void test()
+	{
+		const char* i8hex = ":0C000400000102030405060708090A0BAE\n"
+			":00000001FF\n";
+		I8HEX::Decoder decoder(8, *this);
+		decoder.decode(i8hex, std::strlen(i8hex));
+
+		if (decoder.error() || !decoder.done())
+			fail("decoder failed or not done");
+
+		std::deque<std::pair<std::uint32_t, std::uint8_t>> expected;
+		for (std::uint8_t ix = 0; ix < 12; ++ix)
+			expected.push_back({4 + ix, ix});
+		if (streamed != expected)
+			fail("streamed bytes mismatch");
+
+		// page address, dirty begin and end
+		const std::deque<std::array<std::size_t, 3>> expected_ranges{
+			{{0, 4, 8}}, {{8, 0, 8}}};
+		if (ranges != expected_ranges || !pages.empty())
+			fail("streamed pages mismatch");
+	}
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Streaming bytes without buffer\"";
+	}
+};
+
+// cached decoder has several buffers so is not derived from TestBase
+class Cache_out_of_order : public SinkTestBase<8>
+{
+	virtual void test()
+	{
+		// pages 0, 8, back to 0, then 16 which evicts 8
+		const char* i8hex = ":020000000102FB\n"
+			":020008000304EF\n"
+			":020006000506ED\n"
+			":0100100007E8\n"
+			":00000001FF\n";
+		// whole records and then char by char
+		for (std::size_t chunk : {std::strlen(i8hex), std::size_t(1)})
+		{
+			std::array<std::uint8_t, 16> buffer;
+			buffer.fill(0); // cache pages must be cleared
+			I8HEX::Decoder decoder(buffer.data(), 8, *this, 2);
+			clear();
+			for (const char* c = i8hex; *c && !decoder.done() &&
+				     !decoder.error();)
+				c += decoder.decode(c, std::min(chunk,
+								std::strlen(c)));
+
+			if (decoder.error() || !decoder.done())
+				fail("decoder failed or not done");
+			verify_pages();
+#ifdef I8HEX_DECODER_STATS
+			verify_stats(decoder.get_stats());
+#endif
+		}
+	}
+
+	void verify_pages() const
+	{
+		const page_list expected{
+			{0x08, {{0x03, 0x04, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}},
+			{0x00, {{0x01, 0x02, 0xff, 0xff,
+				 0xff, 0xff, 0x05, 0x06}}},
+			{0x10, {{0x07, 0xff, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}}};
+		if (pages != expected)
+			fail("flushed pages mismatch");
+	}
+
+#ifdef I8HEX_DECODER_STATS
+	void verify_stats(const I8HEX::Decoder::stats_type& stats) const
+	{
+		if (stats.records != 5 || stats.payload_bytes != 7 ||
+		    stats.full_pages != 1 || stats.partial_pages != 2 ||
+		    stats.address_flushes != 1 || stats.pages_merged != 1 ||
+		    stats.pages_revisited != 0)
+			fail("decoder statistics mismatch");
+	}
+#endif
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Cache merges revisited page, evicts LRU\"";
+	}
+};
+
+// pages A, B and back to A, with a single cache page A is flushed twice
+class Cache_revisit : public SinkTestBase<8>
+{
+	virtual void test()
+	{
+		const char* i8hex = ":0100000011EE\n"
+			":0100080022D5\n"
+			":0100010033CB\n"
+			":00000001FF\n";
+		const page_list single{
+			{0x00, {{0x11, 0xff, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}},
+			{0x08, {{0x22, 0xff, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}},
+			{0x00, {{0xff, 0x33, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}}};
+		const page_list cached{
+			{0x00, {{0x11, 0x33, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}},
+			{0x08, {{0x22, 0xff, 0xff, 0xff,
+				 0xff, 0xff, 0xff, 0xff}}}};
+
+		for (std::uint8_t cache_pages :
+			     {std::uint8_t(1), I8HEX::Decoder::max_cache_pages})
+		{
+			// whole records and then char by char
+			for (std::size_t chunk : {std::strlen(i8hex),
+						  std::size_t(1)})
+			{
+				run_case(i8hex, chunk, cache_pages,
+					 cache_pages == 1 ? single : cached);
+			}
+		}
+	}
+
+	void run_case(const char* i8hex, const std::size_t chunk,
+		      const std::uint8_t cache_pages,
+		      const page_list& expected)
+	{
+		std::array<std::uint8_t,
+			   8 * I8HEX::Decoder::max_cache_pages> buffer;
+		I8HEX::Decoder decoder(buffer.data(), 8, *this, cache_pages);
+		clear();
+		for (const char* c = i8hex; *c && !decoder.done() &&
+			     !decoder.error();)
+			c += decoder.decode(c, std::min(chunk, std::strlen(c)));
+
+		if (decoder.error() || !decoder.done())
+			fail("decoder failed or not done");
+		if (pages != expected)
+			fail("flushed pages mismatch");
+	}
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Cache returns to page A after B\"";
+	}
+};
+
+// encode with Encoder and decode the result with Decoder
+class Encoder_round_trip : public SinkTestBase<64>
+{
+public:
+
+	using SinkTestBase<64>::operator();
+
+	// encoder sink
+	void operator()(const char* str, std::size_t length)
+	{
+		hex.append(str, length);
+	}
+
+private:
+
+	virtual void test()
+	{
+		// 600 bytes across a 64K segment with a long run of 0xff
+		// to elide and a short one to keep
+		const std::uint32_t address = 0xff00;
+		std::array<std::uint8_t, 600> data;
+		for (std::size_t ix = 0; ix < data.size(); ++ix)
+			data[ix] = ix * 7;
+		std::fill(data.begin() + 300, data.begin() + 340, 0xff);
+		std::fill(data.begin() + 400, data.begin() + 403, 0xff);
+
+		I8HEX::Encoder encoder(255, *this, true);
+		encoder.encode(address, data.data(), data.size());
+		encoder.end();
+
+		if (hex.find(":020000040001F9\r\n") == std::string::npos)
+			fail("no extended linear address record");
+		if (hex.find(":00000001FF\r\n") != hex.size() - 13)
+			fail("no end of file record at end");
+
+		std::array<std::uint8_t, 64> buffer;
+		std::array<std::uint8_t, 64 / 8> mask;
+		I8HEX::Decoder decoder(buffer.data(), buffer.size(), *this);
+		decoder.set_decoded_mask(mask.data());
+		decoder.decode(hex.data(), hex.size());
+		if (decoder.error() || !decoder.done())
+			fail("decoder failed or not done");
+
+		for (std::size_t ix = 0; ix < data.size(); ++ix)
+		{
+			const auto it = decoded.find(address + ix);
+			const unsigned byte = it == decoded.end() ?
+				0xff : it->second;
+			if (byte != data[ix])
+				fail("decoded data mismatch");
+		}
+		// only the long run of 0xff is elided
+		if (decoded.size() != data.size() - 40)
+			fail("decoded byte count mismatch");
+	}
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Encoder round trip through decoder\"";
+	}
+
+	std::string hex;
+};
+
+// S-records decoded into the pages of a paged decoder
+class SREC_records : public SinkTestBase<8>
+{
+	virtual void test()
+	{
+		// header, data spanning pages 0 and 8, 24 bit address,
+		// count and termination record
+		const char* srec = "S00700007465737438\r\n"
+			"S107000601020304E8\r\n"
+			"S2060100100506DD\r\n"
+			"S5030002FA\r\n"
+			"S9030000FC\r\n";
+		// whole records and then char by char
+		for (std::size_t chunk : {std::strlen(srec), std::size_t(1)})
+		{
+			std::array<std::uint8_t, 16> buffer;
+			paged::Decoder page_decoder(buffer.data(), 8, *this, 2);
+			SREC::Decoder decoder(page_decoder);
+			clear();
+			for (const char* c = srec; *c && !decoder.done() &&
+				     !decoder.error();)
+				c += decoder.decode(c, std::min(chunk,
+								std::strlen(c)));
+
+			if (decoder.error() || !decoder.done())
+				fail("decoder failed or not done");
+			const page_list expected{
+				{0x00000, {{0xff, 0xff, 0xff, 0xff,
+					    0xff, 0xff, 0x01, 0x02}}},
+				{0x00008, {{0x03, 0x04, 0xff, 0xff,
+					    0xff, 0xff, 0xff, 0xff}}},
+				{0x10010, {{0x05, 0x06, 0xff, 0xff,
+					    0xff, 0xff, 0xff, 0xff}}}};
+			if (pages != expected)
+				fail("flushed pages mismatch");
+		}
+
+		std::array<std::uint8_t, 8> buffer;
+		paged::Decoder page_decoder(buffer.data(), 8, *this);
+		SREC::Decoder decoder(page_decoder);
+		const char* bad = "S107000601020304E9\r\n";
+		decoder.decode(bad, std::strlen(bad));
+		if (!decoder.error() ||
+		    std::strcmp(decoder.error(), "Invalid checksum"))
+			fail("checksum error not detected");
+	}
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"S-records into paged decoder\"";
+	}
+};
+
+// raw binary image with CRC trailer decoded into a paged decoder
+class BIN_image : public SinkTestBase<16>
+{
+	virtual void test()
+	{
+		// 20 bytes at 0x1234, across pages 0x1230 to 0x1240
+		std::vector<std::uint8_t> image{0x34, 0x12, 0, 0, 20, 0, 0, 0};
+		for (std::uint8_t ix = 0; ix < 20; ++ix)
+			image.push_back(ix);
+		std::uint16_t crc = 0;
+		for (std::uint8_t byte : image)
+			crc = BIN::Decoder::crc16(crc, byte);
+		image.push_back(crc & 0xff);
+		image.push_back(crc >> 8);
+
+		std::array<std::uint8_t, 16> buffer;
+		paged::Decoder page_decoder(buffer.data(), 16, *this);
+		BIN::Decoder decoder(page_decoder);
+		if (decoder.decode(image.data(), image.size()) != image.size()
+		    || decoder.error() || !decoder.done())
+			fail("decoder failed or not done");
+		if (pages.size() != 2 || pages[0].first != 0x1230 ||
+		    pages[1].first != 0x1240)
+			fail("flushed pages mismatch");
+		for (std::size_t ix = 0; ix < 20; ++ix)
+			if (decoded[0x1234 + ix] != ix)
+				fail("decoded data mismatch");
+
+		// CRC-16/XMODEM check value
+		crc = 0;
+		for (const char* c = "123456789"; *c; ++c)
+			crc = BIN::Decoder::crc16(crc, *c);
+		if (crc != 0x31c3)
+			fail("CRC check value mismatch");
+
+		image[10] ^= 1;
+		paged::Decoder bad_pages(buffer.data(), 16, *this);
+		BIN::Decoder bad(bad_pages);
+		bad.decode(image.data(), image.size());
+		if (!bad.error() || std::strcmp(bad.error(), "Invalid CRC"))
+			fail("CRC error not detected");
+	}
+
+	virtual const char* name() const
+	{
+		return __FILE__ ":" STR(__LINE__)
+			" \"Raw binary image with CRC\"";
+	}
+};
+
 int main()
 {
 	Single_buffer1().run();
@@ -781,6 +1561,27 @@ int main()
 	Multi_buffer3().run();
 	Multi_buffer4().run();
 	Multi_buffer5().run();
+	Multi_buffer6().run();
+	Dirty_range_multi_buffer().run();
+	Dirty_range_next_buffer().run();
+	Multi_buffer_not_power_of_two().run();
+	Decoded_mask_gap().run();
+	Decoded_mask_gap_split().run();
+	Record_across_pages().run();
+	Record_across_pages_split().run();
+	No_buffer_end_of_file().run();
+
+	Extended_linear_address().run();
+	Extended_segment_address().run();
+	Extended_address_length_error().run();
+	Record_type_error().run();
+
+	Streaming_bytes().run();
+	Cache_out_of_order().run();
+	Cache_revisit().run();
+	Encoder_round_trip().run();
+	SREC_records().run();
+	BIN_image().run();
 
 	return 0;
 }
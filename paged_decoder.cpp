@@ -0,0 +1,169 @@
+#include"paged_decoder.hpp"
+
+// value of hexadecimal digit for each character, 0xff if invalid
+const PROGMEM uint8_t paged::Decoder::nibble_table[256] =
+{
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, // '0'
+	0x08, 0x09, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, // 'A'
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, // 'a'
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	// 0x80 to 0xff are all invalid
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+void paged::Decoder::clear_buffer()
+{
+	if (buffer)
+		memset(buffer, -1, page_size);
+	if (decoded_mask)
+		memset(decoded_mask, 0, (page_size + 7) / 8);
+	dirty_begin = page_size;
+	dirty_end = 0;
+}
+
+void paged::Decoder::call_buffer_full_callback()
+{
+#ifdef I8HEX_DECODER_STATS
+	if (dirty_begin == 0 && dirty_end == page_size)
+		++stats.full_pages;
+	else
+		++stats.partial_pages;
+	if (!flushed || buffer_address > highest_flushed)
+		highest_flushed = buffer_address;
+	flushed = true;
+#endif
+	error_str = (*page_sink)(sink_object, *this);
+	clear_buffer();
+}
+
+// save state of the active page and make page ix active and most
+// recently used
+void paged::Decoder::activate_page(const uint8_t ix)
+{
+	pages[active] = cached_page{buffer_address, dirty_begin, dirty_end};
+	active = ix;
+	if (cache)
+		buffer = cache + ix * page_size;
+	if (mask_cache)
+		decoded_mask = mask_cache + ix * mask_bytes();
+	buffer_address = pages[ix].address;
+	dirty_begin = pages[ix].dirty_begin;
+	dirty_end = pages[ix].dirty_end;
+
+	uint8_t pos = 0;
+	while (pos < pages_used && lru[pos] != ix)
+		++pos;
+	for (; pos; --pos)
+		lru[pos] = lru[pos - 1];
+	lru[0] = ix;
+}
+
+// make the page containing address active, taking a free cache page or
+// evicting the least recently used one, return false on callback error
+bool paged::Decoder::select_page(const uint32_t address,
+				 const bool jumped)
+{
+	(void)jumped; // only counted in statistics
+	const uint32_t page_address = address - page_offset(address);
+	// state of the active page is only saved when another is
+	// activated, so save it before searching the cache
+	if (pages_used)
+		pages[active] = cached_page{buffer_address, dirty_begin,
+					    dirty_end};
+	for (uint8_t pos = 0; pos < pages_used; ++pos)
+	{
+		if (pages[lru[pos]].address == page_address)
+		{
+			I8HEX_STATS(++stats.pages_merged);
+			activate_page(lru[pos]);
+			busy = true;
+			return true;
+		}
+	}
+
+	if (pages_used < cache_pages)
+	{
+		lru[pages_used] = pages_used;
+		activate_page(pages_used++);
+		clear_buffer();
+	}
+	else
+	{
+		I8HEX_STATS(if (jumped) ++stats.address_flushes);
+		activate_page(lru[pages_used - 1]);
+		call_buffer_full_callback();
+		if (error_str)
+			return false;
+	}
+	I8HEX_STATS(if (flushed && page_address <= highest_flushed)
+			    ++stats.pages_revisited);
+	buffer_address = page_address;
+	busy = true;
+	return true;
+}
+
+// call buffer full callback for each cached page in address order
+void paged::Decoder::flush_pages()
+{
+	activate_page(active); // save its state
+	while (pages_used && !error_str)
+	{
+		uint8_t lowest = 0;
+		for (uint8_t pos = 1; pos < pages_used; ++pos)
+			if (pages[lru[pos]].address <
+			    pages[lru[lowest]].address)
+				lowest = pos;
+		activate_page(lru[lowest]);
+		call_buffer_full_callback();
+		// drop it, it is now first in lru
+		--pages_used;
+		for (uint8_t pos = 0; pos < pages_used; ++pos)
+			lru[pos] = lru[pos + 1];
+	}
+	busy = false;
+}
+
+void paged::Decoder::store_payload_byte(const uint8_t value)
+{
+	I8HEX_STATS(++stats.payload_bytes);
+	if (offset < dirty_begin)
+		dirty_begin = offset;
+	if (offset >= dirty_end)
+		dirty_end = offset + 1;
+	if (decoded_mask)
+		decoded_mask[offset >> 3] |= 1 << (offset & 7);
+	if (!buffer)
+		error_str = (*byte_sink)(sink_object, *this,
+					 buffer_address + offset, value);
+	else
+		buffer[offset] = value;
+	++offset;
+	--remaining;
+}
@@ -0,0 +1,439 @@
+#ifndef paged_decoder_HPP
+#define paged_decoder_HPP
+
+#include<stdint.h>
+#include<stddef.h>
+#include<string.h>
+
+#ifdef __AVR__
+#include<avr/pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#define pgm_read_byte(addr) (*(addr))
+#endif
+#endif
+
+// most pages the decoder can cache, each costs a few bytes of state
+// (the page buffers themselves are supplied by the user)
+#ifndef I8HEX_DECODER_MAX_CACHE_PAGES
+#define I8HEX_DECODER_MAX_CACHE_PAGES 4
+#endif
+
+// define I8HEX_DECODER_STATS to count what the decoder does, see
+// Decoder::stats_type, it costs nothing when not defined
+#ifdef I8HEX_DECODER_STATS
+#define I8HEX_STATS(statement) statement
+#else
+#define I8HEX_STATS(statement)
+#endif
+
+namespace paged
+{
+	// <type_traits> isn't available on the AVR, these restrict the
+	// sink constructors of Decoder to class types so a function named
+	// without & still takes the callback constructors
+	namespace sink_traits
+	{
+		template <bool, typename T = void>
+		struct enable_if
+		{
+		};
+
+		template <typename T>
+		struct enable_if<true, T>
+		{
+			typedef T type;
+		};
+
+		template <typename T>
+		class is_class
+		{
+			template <typename U>
+			static char test(int U::*);
+			template <typename U>
+			static long test(...);
+
+		public:
+			static constexpr bool value =
+				sizeof(test<T>(nullptr)) == 1;
+		};
+
+		template <typename Sink>
+		using if_class =
+			typename enable_if<is_class<Sink>::value>::type;
+	}
+
+	// Collects bytes decoded from an image format (I8HEX::Decoder,
+	// SREC::Decoder, BIN::Decoder) into target sized pages and hands
+	// them to a callback or sink, this is the common interface of
+	// all formats.
+	class Decoder
+	{
+	public:
+		// callback type used to notify of a decoded buffer
+		// It should return an error string in case of failure
+		// dealing with a full buffer or nullptr if success.
+		// The buffer address in ram, and address on target device
+		// (and page size) can be retrieved from Decoder argument.
+		typedef const char* (*buffer_full_callback_type)
+			(const Decoder&);
+
+		// callback type used to stream each decoded byte instead of
+		// storing it in a buffer, it is passed the byte's address on
+		// target and its value and should return an error string in
+		// case of failure or nullptr if success
+		typedef const char* (*byte_callback_type)
+			(const Decoder&, uint32_t, uint8_t);
+
+		// construct with external buffer to decode bytes into, it
+		// must be cache_pages times the target chip page size.
+		// With more than one cache page, records which
+		// return to a page decoded earlier are merged into it and
+		// bfc is only called when the least recently used page is
+		// evicted or at the end of file (in address order).
+		Decoder(void* const buffer,
+			const size_t page_size,
+			buffer_full_callback_type bfc,
+			const uint8_t cache_pages = 1)
+			: buffer(static_cast<uint8_t*>(buffer))
+			, page_size(page_size)
+			, buffer_full_callback(bfc)
+			, cache(static_cast<uint8_t*>(buffer))
+			, cache_pages(cache_pages < 1 ? 1 :
+				      cache_pages > max_cache_pages ?
+				      max_cache_pages : cache_pages)
+			, offset_mask(offset_mask_for(page_size))
+		{
+			clear_buffer();
+		}
+
+		// construct to stream decoded bytes to bc without a buffer,
+		// bfc is still called at the end of each page (with buffer
+		// nullptr) and the dirty range is tracked as usual
+		Decoder(const size_t page_size,
+			byte_callback_type bc,
+			buffer_full_callback_type bfc)
+			: buffer(nullptr)
+			, page_size(page_size)
+			, buffer_full_callback(bfc)
+			, cache(nullptr)
+			, cache_pages(1)
+			, offset_mask(offset_mask_for(page_size))
+			, byte_callback(bc)
+		{
+			clear_buffer();
+		}
+
+		// construct with external buffer as above handing full
+		// buffers to sink, any object callable as
+		// const char* sink(const Decoder&) which outlives the
+		// decoder.  The sink carries its own context so several
+		// decoders can run at once.  It is called through a
+		// function pointer to a function instantiated for Sink,
+		// its call operator is inlined there but the hand-off
+		// itself is an indirect call per page (per byte when
+		// streaming).  Decoder isn't templated on the sink: each
+		// sink type would get its own copy of the page engine in
+		// the Uno's flash, and the indirect call costs a few
+		// cycles next to the hundreds SPI takes per byte.
+		template <typename Sink,
+			  typename = sink_traits::if_class<Sink>>
+		Decoder(void* const buffer,
+			const size_t page_size,
+			Sink& sink,
+			const uint8_t cache_pages = 1)
+			: Decoder(buffer, page_size, nullptr, cache_pages)
+		{
+			sink_object = &sink;
+			page_sink = &call_page_sink<Sink>;
+		}
+
+		// construct to stream decoded bytes to sink without a
+		// buffer, sink must also be callable as
+		// const char* sink(const Decoder&, uint32_t, uint8_t)
+		template <typename Sink,
+			  typename = sink_traits::if_class<Sink>>
+		Decoder(const size_t page_size, Sink& sink)
+			: Decoder(page_size, nullptr, nullptr)
+		{
+			sink_object = &sink;
+			page_sink = &call_page_sink<Sink>;
+			byte_sink = &call_byte_sink<Sink>;
+		}
+
+		// return address where buffer should be loaded on target
+		// chip, this address is decoded from the input (including
+		// any extended address) and aligned on a page_size boundary
+		uint32_t get_buffer_address_on_target() const
+		{
+			return buffer_address;
+		}
+
+		// return offset into buffer of first byte decoded into it,
+		// bytes before it are untouched (0xff)
+		size_t get_dirty_begin() const
+		{
+			return dirty_begin;
+		}
+
+		// return offset into buffer one past last byte decoded into
+		// it, bytes from it are untouched (0xff)
+		size_t get_dirty_end() const
+		{
+			return dirty_end;
+		}
+
+		// set bit mask to record which bytes of the buffer are
+		// decoded into, it must be at least (page_size + 7) / 8
+		// bytes per cache page and is cleared with the buffer,
+		// nullptr to stop
+		void set_decoded_mask(uint8_t* const mask)
+		{
+			mask_cache = mask;
+			decoded_mask = mask ? mask + active * mask_bytes() :
+				nullptr;
+			if (mask)
+				memset(mask, 0, cache_pages * mask_bytes());
+		}
+
+		// return mask of the buffer set by set_decoded_mask(), bit
+		// (offset & 7) of byte (offset >> 3) is for offset
+		const uint8_t* get_decoded_mask() const
+		{
+			return decoded_mask;
+		}
+
+		// return true if byte at offset into buffer was decoded
+		// into, only valid with a decoded mask set
+		bool is_decoded(const size_t offset) const
+		{
+			return decoded_mask[offset >> 3] & 1 << (offset & 7);
+		}
+
+#ifdef I8HEX_DECODER_STATS
+		struct stats_type
+		{
+			uint16_t records;         // valid records decoded
+			uint32_t payload_bytes;   // data bytes decoded
+			uint16_t full_pages;      // pages flushed with the
+			                          // whole page decoded into
+			                          // (its dirty range)
+			uint16_t partial_pages;   // other pages flushed
+			uint16_t address_flushes; // pages evicted by a record
+			                          // out of the active page
+			uint16_t pages_merged;    // records returning to a
+			                          // cached page
+			uint16_t pages_revisited; // pages at or below the
+			                          // highest flushed page,
+			                          // likely flushed twice
+		};
+
+		const stats_type& get_stats() const
+		{
+			return stats;
+		}
+#endif
+
+		// return true if all input was decoded up to the end of
+		// file (check error() to check if decode was successful)
+		bool done() const
+		{
+			return done_flag;
+		}
+
+		// return nullptr if no errors, otherwise string to error
+		const char* error() const
+		{
+			return error_str;
+		}
+
+		// public for callback to retrieve, nullptr when streaming,
+		// points to the cache page being decoded into or flushed
+		uint8_t* buffer;
+		const size_t page_size;
+
+		// may replace callback if required
+		buffer_full_callback_type buffer_full_callback;
+
+		static constexpr uint8_t max_cache_pages =
+			I8HEX_DECODER_MAX_CACHE_PAGES;
+
+		// store value decoded for address on target into its page,
+		// return false (with error() set) if a callback failed
+		bool store(const uint32_t address, const uint8_t value)
+		{
+			if (!in_buffer(address) &&
+			    !select_page(address, !busy ||
+					 address != buffer_address + page_size))
+				return false;
+			offset = page_offset(address);
+			store_payload_byte(value);
+			return !error_str;
+		}
+
+		// end of input reached, hand over the pages decoded
+		void finish()
+		{
+			done_flag = true;
+			if (busy)
+				flush_pages();
+		}
+
+		// input is invalid, error() returns error from now on
+		void fail(const char* const error)
+		{
+			error_str = error;
+		}
+
+		// count a valid record in the statistics
+		void count_record()
+		{
+			I8HEX_STATS(++stats.records);
+		}
+
+		// return value of hexadecimal digit c, 0xff if invalid
+		static uint8_t nibble(const char c)
+		{
+			return pgm_read_byte(
+				&nibble_table[static_cast<uint8_t>(c)]);
+		}
+
+		// return value of the two hexadecimal digits at str, or -1
+		// if either is invalid
+		static int16_t hex_pair(const char* const str)
+		{
+			const uint8_t msn = nibble(str[0]);
+			const uint8_t lsn = nibble(str[1]);
+			if ((msn | lsn) & 0xf0)
+				return -1;
+			return msn << 4 | lsn;
+		}
+
+	protected:
+
+		static const uint8_t nibble_table[256];
+
+		uint8_t* const cache;        // cache_pages buffers
+		const uint8_t cache_pages;
+		// page_size - 1 if page_size is a power of two (all AVR
+		// page sizes are) so page offsets are masked instead of
+		// needing a slow 32 bit modulo, else 0
+		const uint32_t offset_mask;
+
+		byte_callback_type byte_callback = nullptr;
+
+		// full buffers and streamed bytes are handed over through
+		// these, which call the function pointer callbacks above
+		// unless constructed with a sink object
+		typedef const char* (*page_sink_type)(void*, const Decoder&);
+		typedef const char* (*byte_sink_type)
+			(void*, const Decoder&, uint32_t, uint8_t);
+		void* sink_object = nullptr;
+		page_sink_type page_sink = &call_buffer_full_callback_adapter;
+		byte_sink_type byte_sink = &call_byte_callback_adapter;
+
+		static const char* call_buffer_full_callback_adapter(
+			void*, const Decoder& decoder)
+		{
+			return (*decoder.buffer_full_callback)(decoder);
+		}
+
+		static const char* call_byte_callback_adapter(
+			void*, const Decoder& decoder,
+			const uint32_t address, const uint8_t value)
+		{
+			return (*decoder.byte_callback)(decoder, address,
+							value);
+		}
+
+		template <typename Sink>
+		static const char* call_page_sink(void* sink,
+						  const Decoder& decoder)
+		{
+			return (*static_cast<Sink*>(sink))(decoder);
+		}
+
+		template <typename Sink>
+		static const char* call_byte_sink(void* sink,
+						  const Decoder& decoder,
+						  const uint32_t address,
+						  const uint8_t value)
+		{
+			return (*static_cast<Sink*>(sink))(decoder, address,
+							   value);
+		}
+
+		uint8_t* mask_cache = nullptr;   // cache_pages masks
+		uint8_t* decoded_mask = nullptr; // mask of active page
+
+		// state of cached pages other than the active one, which
+		// is kept in buffer_address, dirty_begin and dirty_end
+		struct cached_page
+		{
+			uint32_t address;
+			size_t dirty_begin;
+			size_t dirty_end;
+		};
+		cached_page pages[max_cache_pages];
+		uint8_t lru[max_cache_pages]; // page indices, most recent
+		                              // first
+		uint8_t pages_used = 0;
+		uint8_t active = 0;           // page decoded into
+
+#ifdef I8HEX_DECODER_STATS
+		stats_type stats = stats_type();
+		bool flushed = false;         // highest_flushed is valid
+		uint32_t highest_flushed;
+#endif
+
+		// busy is false until a byte is to be decoded into a cache
+		// page, offset is where the next byte is decoded into
+		bool busy = false;
+		size_t offset;              // next byte to decode into
+		size_t remaining;           // remaining bytes to decode
+		size_t dirty_begin;         // range of buffer decoded into
+		size_t dirty_end;
+		bool done_flag = false;
+		const char* error_str = nullptr;
+		uint32_t buffer_address; // address of page aligned buffer
+
+		size_t mask_bytes() const
+		{
+			return (page_size + 7) / 8;
+		}
+
+		static uint32_t offset_mask_for(const size_t page_size)
+		{
+			return page_size & (page_size - 1) ? 0 : page_size - 1;
+		}
+
+		// return offset of address within its page
+		size_t page_offset(const uint32_t address) const
+		{
+			return offset_mask ? address & offset_mask :
+				address % page_size;
+		}
+
+		// return true if address is within the buffer being
+		// decoded into
+		bool in_buffer(const uint32_t address) const
+		{
+			if (offset_mask)
+				return busy && (address & ~offset_mask) ==
+					buffer_address;
+			return busy && address >= buffer_address &&
+				address < buffer_address + page_size;
+		}
+
+		void clear_buffer();
+		void call_buffer_full_callback();
+		void activate_page(uint8_t);
+		// jumped is false when continuing into the next page
+		bool select_page(uint32_t address, bool jumped = true);
+		void flush_pages();
+		void store_payload_byte(uint8_t);
+	};
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include"patches.hpp"
+
+#include<Arduino.h>
+#include<avr/eeprom.h>
+#include<HardwareSerial.h>
+
+namespace
+{
+	struct patch_t
+	{
+		uint32_t address;
+		uint8_t length;
+		uint8_t applied;   // bit per byte applied
+		uint32_t increment;
+		uint32_t initial;
+	};
+
+	patch_t patches_list[patches::max_patches];
+	uint8_t patch_count = 0;
+
+	// counters are in Uno EEPROM from address 0, erased EEPROM
+	// (0xffffffff) is an unused counter
+	constexpr uint32_t unused_counter = 0xffffffff;
+
+	uint32_t* counter(const uint8_t ix)
+	{
+		return reinterpret_cast<uint32_t*>(ix * sizeof(uint32_t));
+	}
+
+	uint32_t counter_value(const uint8_t ix)
+	{
+		const uint32_t value = eeprom_read_dword(counter(ix));
+		return value == unused_counter ? patches_list[ix].initial
+					       : value;
+	}
+}
+
+void patches::clear()
+{
+	patch_count = 0;
+}
+
+bool patches::add(const uint32_t address,
+		  const uint8_t length,
+		  const uint32_t increment,
+		  const uint32_t initial)
+{
+	if (!length || length > sizeof(uint32_t) || patch_count == max_patches)
+		return false;
+	patches_list[patch_count++] =
+		patch_t{address, length, 0, increment, initial};
+	return true;
+}
+
+void patches::apply(const uint32_t address,
+		    uint8_t* buffer,
+		    const uint16_t page_size,
+		    uint16_t& begin,
+		    uint16_t& end,
+		    uint8_t* const mask)
+{
+	for (uint8_t ix = 0; ix < patch_count; ++ix)
+	{
+		patch_t& patch = patches_list[ix];
+		const uint32_t value = counter_value(ix);
+		for (uint8_t byte = 0; byte < patch.length; ++byte)
+		{
+			const uint32_t byte_address = patch.address + byte;
+			if (byte_address < address ||
+			    byte_address - address >= page_size)
+				continue;
+			const uint16_t offset = byte_address - address;
+			buffer[offset] = value >> byte * 8;
+			if (mask)
+				mask[offset >> 3] |= 1 << (offset & 7);
+			patch.applied |= 1 << byte;
+			if (offset < begin)
+				begin = offset;
+			if (offset >= end)
+				end = offset + 1;
+		}
+	}
+}
+
+bool patches::all_applied()
+{
+	for (uint8_t ix = 0; ix < patch_count; ++ix)
+		if (patches_list[ix].applied !=
+		    (1 << patches_list[ix].length) - 1)
+			return false;
+	return true;
+}
+
+void patches::commit()
+{
+	for (uint8_t ix = 0; ix < patch_count; ++ix)
+	{
+		patch_t& patch = patches_list[ix];
+		const uint32_t value = counter_value(ix);
+		Serial.print(F("Patch "));
+		Serial.print(ix);
+		Serial.print(F(" at 0x"));
+		Serial.print(patch.address, HEX);
+		Serial.print(F(" = 0x"));
+		Serial.println(value, HEX);
+		eeprom_update_dword(counter(ix), value + patch.increment);
+		patch.applied = 0;
+	}
+}
+
+void patches::output_counters()
+{
+	for (uint8_t ix = 0; ix < max_patches; ++ix)
+	{
+		const uint32_t value = eeprom_read_dword(counter(ix));
+		Serial.print(F("Counter "));
+		Serial.print(ix);
+		Serial.print(F(" = "));
+		if (value == unused_counter)
+		{
+			Serial.println(F("unused"));
+		}
+		else
+		{
+			Serial.print(F("0x"));
+			Serial.println(value, HEX);
+		}
+	}
+}
+
+void patches::reset_counters()
+{
+	for (uint8_t ix = 0; ix < max_patches; ++ix)
+		eeprom_update_dword(counter(ix), unused_counter);
+}
@@ -0,0 +1,47 @@
+#ifndef PATCHES_HPP
+#define PATCHES_HPP
+
+#include<stdint.h>
+
+namespace patches
+{
+	// A patch overwrites bytes of flash pages as they are loaded with
+	// the value of a counter (little endian, like AVR data), e.g. to
+	// give every unit a unique serial number from the same image.
+	// Patches are numbered in the order they are added and each uses
+	// the counter of the same number, counters are kept in the Uno's
+	// EEPROM and advanced by their patch's increment once a target
+	// has loaded successfully.
+
+	constexpr uint8_t max_patches = 4;
+
+	// remove all patches (counters are kept)
+	void clear();
+
+	// Add patch of length (1 to 4) bytes at flash address, its counter
+	// starts at initial if it has never been used (or was reset).
+	// Return false if length is invalid or there are max_patches.
+	bool add(uint32_t address, uint8_t length, uint32_t increment,
+		 uint32_t initial = 0);
+
+	// write counter bytes of patches within page at address to buffer,
+	// widening byte range [begin, end) of buffer to include them and
+	// setting their bits in mask (bit per byte of buffer) if given
+	void apply(uint32_t address, uint8_t* buffer, uint16_t page_size,
+		   uint16_t& begin, uint16_t& end, uint8_t* mask = nullptr);
+
+	// return true if all bytes of every patch have been applied
+	bool all_applied();
+
+	// advance counters of patches by their increments and output the
+	// values which were used on Serial
+	void commit();
+
+	// output counters on Serial
+	void output_counters();
+
+	// reset all counters so patches start at their initial values
+	void reset_counters();
+}
+
+#endif
@@ -5,6 +5,113 @@
 
 #include"util.hpp"
 
+namespace
+{
+	using spi_programmer::write_op;
+	using spi_programmer::write_op_count;
+	using spi_programmer::busy_times_t;
+
+	struct write_timing_t
+	{
+		uint16_t twd[write_op_count]; // indexed by write_op
+		bool rdy_bsy_poll;
+	};
+
+	// used until a device is known, generous enough for any AVR
+	constexpr write_timing_t default_write_timing = {
+		{10000, 10000, 20000, 10000},
+		true
+	};
+
+	write_timing_t write_timing = default_write_timing;
+
+	// polling gives up after this many times tWD
+	constexpr uint8_t poll_timeout_twd_multiple = 4;
+
+	write_op pending_op = write_op::none;
+	uint32_t pending_since; // micros() when pending_op was issued
+
+	// implemented fuse bits of the device, all bits until it is known
+	spi_programmer::fuses_t fuse_masks{0xff, 0xff, 0xff, 0xff};
+
+	// return true if the implemented bits of fuse bytes are equal
+	bool fuse_equal(const uint8_t a, const uint8_t b, const uint8_t mask)
+	{
+		return !((a ^ b) & mask);
+	}
+
+	bool fuses_equal(const spi_programmer::fuses_t& a,
+			 const spi_programmer::fuses_t& b)
+	{
+		return fuse_equal(a.lock, b.lock, fuse_masks.lock) &&
+			fuse_equal(a.low, b.low, fuse_masks.low) &&
+			fuse_equal(a.high, b.high, fuse_masks.high) &&
+			fuse_equal(a.ext, b.ext, fuse_masks.ext);
+	}
+
+	busy_times_t busy_times[write_op_count];
+
+	// no device has this many 64K word segments
+	constexpr uint8_t unknown_extended_address = 0xff;
+
+	// extended address byte last loaded, unknown_extended_address on
+	// entering programming (the target's may survive a re-enable) or
+	// after another target is selected
+	uint8_t extended_address = unknown_extended_address;
+
+	// issue Load Extended Address byte if word_address is in a
+	// different 64K word segment than the previous access
+	void load_extended_address(const uint32_t word_address,
+				   const bool verbose)
+	{
+		const uint8_t ext = word_address >> 16;
+		if (ext != extended_address)
+		{
+			spi_programmer::spi_trans(0x4D, 0x00, ext, 0x00,
+						  verbose);
+			extended_address = ext;
+		}
+	}
+
+	const PROGMEM char write_op_flash_name[] = "flash ";
+	const PROGMEM char write_op_eeprom_name[] = "eeprom";
+	const PROGMEM char write_op_erase_name[] = "erase ";
+	const PROGMEM char write_op_fuse_name[] = "fuse  ";
+
+	const char* const PROGMEM write_op_names[write_op_count] = {
+		write_op_flash_name,
+		write_op_eeprom_name,
+		write_op_erase_name,
+		write_op_fuse_name
+	};
+
+	void begin_write(const write_op op)
+	{
+		pending_op = op;
+		pending_since = micros();
+	}
+
+	void record_busy_time(const uint8_t op, const uint32_t us)
+	{
+		busy_times_t& bt = busy_times[op];
+		if (bt.samples == 0xffff)
+			return; // saturated, keep mean meaningful
+
+		uint32_t bucket = us * 8 / write_timing.twd[op];
+		if (bucket >= busy_times_t::buckets)
+			bucket = busy_times_t::buckets - 1;
+		++bt.count[bucket];
+
+		const uint16_t us16 = us > 0xffff ? 0xffff : us;
+		if (!bt.samples || us16 < bt.min_us)
+			bt.min_us = us16;
+		if (us16 > bt.max_us)
+			bt.max_us = us16;
+		bt.total_us += us;
+		++bt.samples;
+	}
+}
+
 void spi_programmer::powerup_avr()
 {
 	delay(100);
@@ -26,6 +133,8 @@ bool spi_programmer::program_enable(SPISettings spi_settings,
 {
 	SPI.begin();
 	SPI.beginTransaction(spi_settings);
+	pending_op = write_op::none;
+	invalidate_extended_address();
 
 	bool success;
 	do
@@ -62,6 +171,12 @@ void spi_programmer::program_disable()
 	SPI.end();
 }
 
+void spi_programmer::set_clock(const uint32_t clock_rate)
+{
+	SPI.endTransaction();
+	SPI.beginTransaction(SPISettings(clock_rate, MSBFIRST, SPI_MODE0));
+}
+
 uint32_t spi_programmer::read_signature(bool verbose)
 {
 	if (verbose)
@@ -95,22 +210,47 @@ spi_programmer::fuses_t spi_programmer::read_fuses(bool verbose)
 	return fuses;
 }
 
-void spi_programmer::write_fuses(const spi_programmer::fuses_t& fuses,
-				 bool verbose)
+uint8_t spi_programmer::write_fuses(const spi_programmer::fuses_t& fuses,
+				    bool verbose)
 {
 	if (verbose)
 	{
 		Serial.print(F("Writing fuses: "));
 		output_fuses(fuses);
 	}
-	spi_trans(0xAC, 0xE0, 0x00, fuses.lock, verbose);
-	wait_device_ready();
-	spi_trans(0xAC, 0xA0, 0x00, fuses.low, verbose);
-	wait_device_ready();
-	spi_trans(0xAC, 0xA8, 0x00, fuses.high, verbose);
-	wait_device_ready();
-	spi_trans(0xAC, 0xA4, 0x00, fuses.ext, verbose);
+
+	// lock bits last, once set they may prevent writing fuses
+	const fuses_t current = read_fuses(verbose);
+	const struct
+	{
+		uint8_t instruction;
+		uint8_t fuses_t::*fuse;
+	} fuse_writes[] = {
+		{0xA0, &fuses_t::low},
+		{0xA8, &fuses_t::high},
+		{0xA4, &fuses_t::ext},
+		{0xE0, &fuses_t::lock}
+	};
+
+	uint8_t written = 0;
+	for (const auto& fw : fuse_writes)
+	{
+		if (fuse_equal(current.*fw.fuse, fuses.*fw.fuse,
+			       fuse_masks.*fw.fuse))
+			continue;
+		wait_device_ready();
+		spi_trans(0xAC, fw.instruction, 0x00, fuses.*fw.fuse, verbose);
+		begin_write(write_op::fuse);
+		++written;
+	}
 	wait_device_ready();
+
+	if (verbose)
+	{
+		Serial.print(F("Fuse bytes written "));
+		Serial.println(written);
+	}
+	return written;
 }
 
 bool spi_programmer::write_verify_fuses(
@@ -119,11 +259,11 @@ bool spi_programmer::write_verify_fuses(
 {
 	write_fuses(fuses, verbose);
 	fuses_t readfuses = read_fuses(verbose);
-	if (readfuses != fuses)
+	if (!fuses_equal(readfuses, fuses))
 	{
 		Serial.println(F("Failed to write fuses, "
 				 "tried to write:"));
-		output_fuses_pgm(fuses);
+		output_fuses(fuses);
 		Serial.println(F("but read fuses back as:"));
 		output_fuses(readfuses);
 		return false;
@@ -131,13 +271,19 @@ bool spi_programmer::write_verify_fuses(
 	return true;
 }
 
-void spi_programmer::read_program_memory(uint16_t address, void *buffer,
+void spi_programmer::invalidate_extended_address()
+{
+	extended_address = unknown_extended_address;
+}
+
+void spi_programmer::read_program_memory(uint32_t address, void *buffer,
 					 size_t bytes, bool verbose)
 {
 	char* bufptr = reinterpret_cast<char*>(buffer);
 	address >>= 1;
 	for (; bytes; ++address, bytes -= 2)
 	{
+		load_extended_address(address, verbose);
 		*bufptr++ = spi_trans(0x20,
 				      address >> 8,
 				      address & 0xff,
@@ -151,7 +297,7 @@ void spi_programmer::read_program_memory(uint16_t address, void *buffer,
 	}
 }
 
-void spi_programmer::load_program_memory(uint16_t address,
+void spi_programmer::load_program_memory(uint32_t address,
 					 const void *buffer,
 					 size_t bytes,
 					 bool verbose)
@@ -173,10 +319,61 @@ void spi_programmer::load_program_memory(uint16_t address,
 	}
 }
 
-void spi_programmer::write_program_page(uint16_t address, bool verbose)
+void spi_programmer::load_program_byte(uint32_t address,
+				       const uint8_t value,
+				       bool verbose)
+{
+	const uint8_t instruction = address & 1 ? 0x48 : 0x40;
+	address >>= 1;
+	spi_trans(instruction, address >> 8, address & 0xff, value, verbose);
+}
+
+void spi_programmer::write_program_page(uint32_t address, bool verbose)
 {
 	address >>= 1;
+	load_extended_address(address, verbose);
 	spi_trans(0x4c, address >> 8, address & 0xff, 0x00, verbose);
+	begin_write(write_op::flash);
+}
+
+void spi_programmer::read_eeprom_memory(uint16_t address, void* buffer,
+					size_t bytes, bool verbose)
+{
+	char* bufptr = reinterpret_cast<char*>(buffer);
+	for (; bytes; ++address, --bytes)
+	{
+		*bufptr++ = spi_trans(0xA0,
+				      address >> 8,
+				      address & 0xff,
+				      0x00,
+				      verbose);
+	}
+}
+
+void spi_programmer::write_eeprom_byte(uint16_t address, uint8_t value,
+				       bool verbose)
+{
+	spi_trans(0xC0, address >> 8, address & 0xff, value, verbose);
+	begin_write(write_op::eeprom);
+}
+
+void spi_programmer::load_eeprom_page(uint16_t address,
+				      const void* buffer,
+				      size_t bytes,
+				      bool verbose)
+{
+	const char* bufptr = reinterpret_cast<const char*>(buffer);
+	for (; bytes; ++address, --bytes)
+	{
+		// only the page offset bits of the address are used
+		spi_trans(0xC1, 0x00, address & 0xff, *bufptr++, verbose);
+	}
+}
+
+void spi_programmer::write_eeprom_page(uint16_t address, bool verbose)
+{
+	spi_trans(0xC2, address >> 8, address & 0xff, 0x00, verbose);
+	begin_write(write_op::eeprom);
 }
 
 uint16_t spi_programmer::spi_trans(uint8_t a, uint8_t b,
@@ -221,10 +418,119 @@ bool spi_programmer::device_busy()
 	return spi_trans(0xF0, 0x00, 0x00, 0x00, false) & 0x01;
 }
 
-void spi_programmer::wait_device_ready()
+void spi_programmer::set_device(const devices::device_pgm_t* dev_ptr)
+{
+	if (dev_ptr)
+	{
+		fuse_masks = fuses_t(dev_ptr->get_fuse_mask_lock(),
+				     dev_ptr->get_fuse_mask_low(),
+				     dev_ptr->get_fuse_mask_high(),
+				     dev_ptr->get_fuse_mask_ext());
+		write_timing.twd[static_cast<uint8_t>(write_op::flash)] =
+			dev_ptr->get_twd_flash();
+		write_timing.twd[static_cast<uint8_t>(write_op::eeprom)] =
+			dev_ptr->get_twd_eeprom();
+		write_timing.twd[static_cast<uint8_t>(write_op::erase)] =
+			dev_ptr->get_twd_erase();
+		write_timing.twd[static_cast<uint8_t>(write_op::fuse)] =
+			dev_ptr->get_twd_fuse();
+		write_timing.rdy_bsy_poll = dev_ptr->get_rdy_bsy_poll();
+	}
+	else
+	{
+		fuse_masks = fuses_t(0xff, 0xff, 0xff, 0xff);
+		write_timing = default_write_timing;
+	}
+}
+
+bool spi_programmer::wait_device_ready()
+{
+	const uint8_t op = static_cast<uint8_t>(pending_op);
+	if (pending_op == write_op::none)
+		pending_since = micros(); // only guard against busy device
+
+	bool ready = true;
+	if (write_timing.rdy_bsy_poll)
+	{
+		// tight polling, each poll is a single SPI transaction
+		const uint32_t timeout = static_cast<uint32_t>(
+			write_timing.twd[op < write_op_count ?
+					 op :
+					 static_cast<uint8_t>(write_op::erase)])
+			* poll_timeout_twd_multiple;
+		while (device_busy())
+		{
+			if (micros() - pending_since > timeout)
+			{
+				ready = false;
+				break;
+			}
+		}
+	}
+	else if (op < write_op_count)
+	{
+		// no polling, wait out the remainder of tWD
+		while (micros() - pending_since < write_timing.twd[op])
+			;
+	}
+
+	if (op < write_op_count)
+		record_busy_time(op, micros() - pending_since);
+	pending_op = write_op::none;
+	return ready;
+}
+
+const spi_programmer::busy_times_t& spi_programmer::get_busy_times(
+	const write_op op)
+{
+	return busy_times[static_cast<uint8_t>(op)];
+}
+
+void spi_programmer::clear_busy_times()
+{
+	memset(busy_times, 0, sizeof(busy_times));
+}
+
+void spi_programmer::output_busy_times()
 {
-	while (device_busy())
-		delay(1);
+	Serial.print(F("Write busy times in us ("));
+	Serial.print(write_timing.rdy_bsy_poll ? F("polled") : F("timed"));
+	Serial.println(F("), histogram in eighths of tWD"));
+	for (uint8_t op = 0; op < write_op_count; ++op)
+	{
+		const busy_times_t& bt = busy_times[op];
+		Serial.print(util::FF(&write_op_names[op]));
+		Serial.print(F(" tWD="));
+		Serial.print(write_timing.twd[op]);
+		Serial.print(F(" n="));
+		Serial.print(bt.samples);
+		if (bt.samples)
+		{
+			Serial.print(F(" min="));
+			Serial.print(bt.min_us);
+			Serial.print(F(" mean="));
+			Serial.print(bt.total_us / bt.samples);
+			Serial.print(F(" max="));
+			Serial.print(bt.max_us);
+			Serial.println();
+			for (uint8_t b = 0; b < busy_times_t::buckets; ++b)
+			{
+				Serial.print(b ? F(" ") : F("  "));
+				if (b == busy_times_t::buckets - 1)
+				{
+					Serial.print('>');
+				}
+				else
+				{
+					Serial.print(b);
+					Serial.print(F("/8"));
+				}
+				Serial.print(':');
+				Serial.print(bt.count[b]);
+			}
+		}
+		Serial.println();
+	}
 }
 
 void spi_programmer::output_fuses(const spi_programmer::fuses_t& fuses)
@@ -249,6 +555,7 @@ void spi_programmer::output_fuses_pgm(const spi_programmer::fuses_t& fuses)
 void spi_programmer::perform_chip_erase(bool verbose)
 {
 	spi_trans(0xAC, 0x80, 0, 0, verbose);
+	begin_write(write_op::erase);
 }
 
 void spi_programmer::failure(const char* error)
@@ -7,6 +7,8 @@
 #include<stddef.h>
 #include<stdint.h>
 
+#include"devices.hpp"
+
 namespace spi_programmer
 {
 	// These functions use Serial for errors, ensure it is initialised
@@ -54,32 +56,106 @@ namespace spi_programmer
 			    bool verbose = false);
 	void program_disable();
 
+	// change SPI clock rate while programming is enabled
+	void set_clock(uint32_t clock_rate);
+
 	uint32_t read_signature(bool verbose = false);
 	fuses_t read_fuses(bool verbose = false);
 
-	void write_fuses(const fuses_t&, bool verbose = false);
+	// Write only the fuse bytes whose implemented bits differ from the
+	// device's (lock last), return number of bytes written
+	uint8_t write_fuses(const fuses_t&, bool verbose = false);
 	bool write_verify_fuses(const fuses_t&, bool verbose = false);
 
+	// Program memory addresses are byte addresses, for devices with
+	// more than 64K words of flash the Load Extended Address byte is
+	// issued by these whenever the address crosses a 64K word boundary.
+
+	// forget the Load Extended Address byte last issued so the next
+	// program memory access issues it again, as the target selected
+	// now may have a different one loaded (gang sockets)
+	void invalidate_extended_address();
+
 	// read program memory bytes of target device from an even
 	// address into buffer (address and bytes *must* be even)
-	void read_program_memory(uint16_t address, void* buffer,
+	void read_program_memory(uint32_t address, void* buffer,
 				 size_t bytes, bool verbose = false);
 
 	// load program memory bytes into target device page buffer
 	// from an even address from buffer
 	// (address and bytes *must* be even)
-	void load_program_memory(uint16_t address, const void* buffer,
+	void load_program_memory(uint32_t address, const void* buffer,
 				 size_t bytes, bool verbose = false);
 
+	// load a single program memory byte into target device page buffer
+	void load_program_byte(uint32_t address, uint8_t value,
+			       bool verbose = false);
+
 	// write previously loaded page buffer into program memory
-	void write_program_page(uint16_t address, bool verbose = false);
+	void write_program_page(uint32_t address, bool verbose = false);
+
+	// read EEPROM bytes of target device into buffer
+	void read_eeprom_memory(uint16_t address, void* buffer,
+				size_t bytes, bool verbose = false);
+
+	// write a single EEPROM byte (for devices without EEPROM pages)
+	void write_eeprom_byte(uint16_t address, uint8_t,
+			       bool verbose = false);
+
+	// load EEPROM bytes into target device EEPROM page buffer
+	// from address which is the start of the page or within it
+	void load_eeprom_page(uint16_t address, const void* buffer,
+			      size_t bytes, bool verbose = false);
+
+	// write previously loaded EEPROM page buffer into EEPROM
+	void write_eeprom_page(uint16_t address, bool verbose = false);
 
 	uint16_t spi_trans(uint8_t, uint8_t, uint8_t, uint8_t,
 			   bool verbose = false);
 
+	// operations after which the device is busy writing
+	enum class write_op : uint8_t
+	{
+		flash,
+		eeprom,
+		erase,
+		fuse,
+		none
+	};
+
+	constexpr uint8_t write_op_count = static_cast<uint8_t>(write_op::none);
+
+	// Use write delays, RDY/BSY polling support and fuse masks of
+	// device in program memory for subsequent waits and fuse writes,
+	// nullptr selects conservative defaults with polling and all
+	// fuse bits for unknown devices.
+	void set_device(const devices::device_pgm_t*);
+
 	// return true if rdy/bsy flag is set (true when device is busy)
 	bool device_busy();
-	void wait_device_ready();
+
+	// Wait until the last write operation has completed, either by
+	// polling RDY/BSY or waiting for the remainder of its tWD.
+	// Return false if polling timed out (device still busy).
+	bool wait_device_ready();
+
+	// histogram of measured busy times per write operation,
+	// buckets are eighths of the operation's tWD with the last
+	// bucket counting anything longer
+	struct busy_times_t
+	{
+		static constexpr uint8_t buckets = 10;
+		uint16_t count[buckets];
+		uint16_t min_us;
+		uint16_t max_us;
+		uint32_t total_us;
+		uint16_t samples;
+	};
+
+	const busy_times_t& get_busy_times(write_op);
+	void clear_busy_times();
+	// output busy time histograms on Serial
+	void output_busy_times();
 
 	// output fuses on Serial
 	void output_fuses(const fuses_t&);
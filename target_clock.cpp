@@ -0,0 +1,40 @@
+#include"target_clock.hpp"
+
+#include<Arduino.h>
+#include<avr/io.h>
+
+namespace
+{
+	uint32_t current_frequency = 0;
+}
+
+void target_clock::start(const uint32_t frequency)
+{
+	stop();
+	if (!frequency)
+		return;
+
+	uint32_t divisor = (F_CPU / 2 + frequency - 1) / frequency;
+	if (divisor > 0x10000)
+		divisor = 0x10000;
+
+	OCR1A = divisor - 1;
+	TCNT1 = 0;
+	TCCR1A = 1 << COM1A0;              // toggle OC1A on compare match
+	TCCR1B = 1 << WGM12 | 1 << CS10;   // CTC, no prescaling
+	pinMode(pin, OUTPUT);
+	current_frequency = F_CPU / 2 / divisor;
+}
+
+void target_clock::stop()
+{
+	TCCR1A = 0;
+	TCCR1B = 0;
+	pinMode(pin, INPUT);
+	current_frequency = 0;
+}
+
+uint32_t target_clock::frequency()
+{
+	return current_frequency;
+}
@@ -0,0 +1,25 @@
+#ifndef TARGET_CLOCK_HPP
+#define TARGET_CLOCK_HPP
+
+#include<stdint.h>
+
+namespace target_clock
+{
+	// Clock output for targets whose fuses select an external clock
+	// which isn't fitted, wire pin to the target's XTAL1 (CLKI).  It is
+	// generated by Timer1 toggling OC1A in CTC mode so frequencies are
+	// F_CPU / 2 / n, i.e. 8, 4, 2, 1 MHz ... on an Uno.  Pin 9 is also
+	// VCC of high voltage serial programming, stop the clock first.
+
+	constexpr uint8_t pin = 9;
+
+	// start clock at the highest supported frequency not above
+	// frequency (0 stops it)
+	void start(uint32_t frequency);
+	void stop();
+
+	// return frequency of clock output, 0 if stopped
+	uint32_t frequency();
+}
+
+#endif
@@ -16,14 +16,8 @@ namespace
 		return 0xff;
 	}
 
-	// hex digits for input (mixed case) and output (upper case only)
+	// hex digits for input (mixed case)
 	const char hexdigits[] = "0123456789ABCDEFabcdef";
-
-	void serial_write_byte(const uint8_t byte)
-	{
-		Serial.print(hexdigits[byte >> 4]);
-		Serial.print(hexdigits[byte & 0x0f]);
-	}
 }
 
 char util::serial_read_char()
@@ -37,6 +31,12 @@ char util::serial_read_char()
 	return c;
 }
 
+uint8_t util::serial_read_byte()
+{
+	do { } while (!Serial.available());
+	return Serial.read();
+}
+
 char util::serial_read_char_of(const char *options)
 {
 	int ix = -1;
@@ -69,16 +69,16 @@ uint8_t util::serial_read_hex_byte()
 	return nibble_for_hex_digit(msn) << 4 | nibble_for_hex_digit(lsn);
 }
 
-uint16_t util::serial_read_power_of_two(uint16_t start)
+uint32_t util::serial_read_power_of_two(uint32_t start)
 {
 	char valid_chars[] = "idq0123456789";
 	static const int slots = 8;
-	uint16_t values[slots];
-	uint16_t value = 0;
+	uint32_t values[slots];
+	uint32_t value = 0;
 	do
 	{
 		Serial.println(F("Select one of these sizes:"));
-		uint16_t t = start;
+		uint32_t t = start;
 		for (int i = 0; i < slots && t; ++i)
 		{
 			Serial.print(i);
@@ -154,26 +154,9 @@ size_t util::serial_read_until_nl(char* buffer, size_t length)
 	return length;
 }
 
-void util::serial_write_I8HEX(const uint16_t address,
-			      const char* data, uint8_t bytes)
+void util::serial_write(const char* str, const size_t length)
 {
-	Serial.print(':');
-	serial_write_byte(bytes);
-	serial_write_byte(address >> 8);
-	serial_write_byte(address & 0xff);
-	Serial.print("00");
-
-	uint8_t checksum = bytes + (address >> 8) + (address & 0xff);
-
-	for (; bytes; ++data, --bytes)
-	{
-		serial_write_byte(*data);
-		checksum += *data;
-	}
-
-	serial_write_byte(-checksum);
-
-	Serial.println();
+	Serial.write(str, length);
 }
 
 bool util::impl::serial_read_value(
@@ -182,25 +165,31 @@ bool util::impl::serial_read_value(
 	char& last_char)
 {
 	size_t digits_read = 0;
-	char c = 0;
-	for (; digits_read < max_digits; ++digits_read)
+	char c;
+	do
+	{
+		c = serial_read_char(); // skip separating blanks
+	} while (c == ' ' || c == '\t');
+
+	for (;; c = serial_read_char())
 	{
-		c = serial_read_char();
 		uint8_t nibble = nibble_for_hex_digit(c);
 		if (nibble == 0xff)
 			break;
-		value = value << 8 | nibble;
+		if (digits_read == max_digits)
+		{
+			last_char = c;
+			Serial.println(F("Too many hex digits for value"));
+			return false;
+		}
+		value = value << 4 | nibble;
+		++digits_read;
 	}
 
-	if (digits_read && digits_read <= max_digits && isspace(c))
-	{
-		c = last_char;
+	last_char = c;
+	if (digits_read && isspace(c))
 		return true;
-	}
 
-	if (digits_read == max_digits)
-		Serial.println(F("Too many hex digits for value"));
-	else
-		Serial.println(F("Invalid non-hex digit read"));
+	Serial.println(F("Invalid non-hex digit read"));
 	return false;
 }
@@ -26,6 +26,10 @@ namespace util
 	// read single char from serial, blocks until one is available
 	char serial_read_char();
 
+	// read single byte from serial, blocks until one is available,
+	// unlike serial_read_char() no byte is ignored
+	uint8_t serial_read_byte();
+
 	// read single character from serial and return it, keep on
 	// reading until one of characters in the C string options
 	// is read
@@ -38,24 +42,22 @@ namespace util
 	// presents menu on serial prompting for a power of 2
 	// returns 0 if user selected to abort
 	// start must be a power of two, no validation/correction is done
-	uint16_t serial_read_power_of_two(uint16_t start = 2);
+	uint32_t serial_read_power_of_two(uint32_t start = 2);
 
 	// read into buffer up to and including newline or length,
 	// return bytes stored in buffer including newline
 	size_t serial_read_until_nl(char* buffer, size_t length);
 
-	// read hex digits from serial converting to binary value up to
-	// first non-hex or overflow digit and store it in last_char
-	// return true if valid value, false if overflow or no hex digits
+	// skip blanks then read hex digits from serial converting to
+	// binary value up to first non-hex or overflow digit and store
+	// it in last_char, return true if valid value terminated by
+	// white space, false if overflow or no hex digits
 	template <typename T>
 	bool serial_read_value(T& value, char& last_char);
 
-	// write I8HEX format output on serial representing data for
-	// a length of bytes (address is where the data resided in
-	// program memory of the target device)
-	void serial_write_I8HEX(const uint16_t address,
-				const char* data,
-				uint8_t bytes);
+	// write length chars of str on serial, used as I8HEX::Encoder
+	// write callback
+	void serial_write(const char* str, size_t length);
 
 	namespace impl
 	{